@@ -0,0 +1,190 @@
+/* Lock-free bitmaps for sharing between threads
+ *
+ * atomic_bitmap<N> and dynamic_atomic_bitmap mirror bitmap and
+ * dynamic_bitmap for concurrent use as slot/ID allocators: every single-bit
+ * operation is one atomic RMW on the chunk holding the bit, and
+ * claim_first_zero() finds and takes a free bit with a CAS.
+ *
+ * Successful claims (test_and_set, claim_first_zero) are acquire and
+ * releases (reset, test_and_reset) are release, so a claimed bit can guard
+ * the data it indexes. count() is a relaxed snapshot.
+ */
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+#include "util/bit.hh"
+
+namespace util
+{
+namespace detail
+{
+/* Operations shared by both atomic bitmaps; Derived provides chunks(),
+ * chunk_count() and size() */
+template <class Derived>
+class atomic_bitmap_ops
+{
+protected:
+  using ChunkT = std::uint64_t;
+  constexpr static std::size_t CHUNK_BITS = std::numeric_limits<ChunkT>::digits;
+
+private:
+  Derived &self() { return static_cast<Derived &>(*this); }
+  Derived const &self() const { return static_cast<Derived const &>(*this); }
+
+  std::atomic<ChunkT> &chunk_of(std::size_t bit)
+  {
+    if (bit >= self().size()) throw std::range_error("invalid index");
+    return self().chunks()[bit / CHUNK_BITS];
+  }
+  std::atomic<ChunkT> const &chunk_of(std::size_t bit) const
+  {
+    if (bit >= self().size()) throw std::range_error("invalid index");
+    return self().chunks()[bit / CHUNK_BITS];
+  }
+  static ChunkT mask_of(std::size_t bit)
+  {
+    return ChunkT(1) << (bit % CHUNK_BITS);
+  }
+
+  /* Bits of chunk i that lie inside the bitmap */
+  ChunkT valid_mask(std::size_t i) const
+  {
+    std::size_t const pad = CHUNK_BITS * self().chunk_count() - self().size();
+    return i + 1 == self().chunk_count() ? ~ChunkT(0) >> pad : ~ChunkT(0);
+  }
+
+public:
+  bool test(std::size_t bit) const
+  {
+    return chunk_of(bit).load(std::memory_order_acquire) & mask_of(bit);
+  }
+
+  void set(std::size_t bit)
+  {
+    chunk_of(bit).fetch_or(mask_of(bit), std::memory_order_release);
+  }
+
+  void reset(std::size_t bit)
+  {
+    chunk_of(bit).fetch_and(~mask_of(bit), std::memory_order_release);
+  }
+
+  /* Sets the bit; returns whether it was already set */
+  bool test_and_set(std::size_t bit)
+  {
+    return chunk_of(bit).fetch_or(mask_of(bit), std::memory_order_acq_rel) &
+           mask_of(bit);
+  }
+
+  /* Clears the bit; returns whether it was set */
+  bool test_and_reset(std::size_t bit)
+  {
+    return chunk_of(bit).fetch_and(~mask_of(bit), std::memory_order_acq_rel) &
+           mask_of(bit);
+  }
+
+  /* Atomically claims a clear bit, scanning from hint and wrapping around.
+   * Returns the bit claimed, or size() if every bit was set. Spreading hints
+   * across threads (e.g. a per-thread start) keeps claimers off each other's
+   * chunks. */
+  std::size_t claim_first_zero(std::size_t hint = 0)
+  {
+    std::size_t const n = self().chunk_count();
+    if (n == 0) return self().size();
+    std::size_t const start = hint < self().size() ? hint / CHUNK_BITS : 0;
+    for (std::size_t k = 0; k < n; ++k) {
+      std::size_t const i = start + k < n ? start + k : start + k - n;
+      std::atomic<ChunkT> &chunk = self().chunks()[i];
+      ChunkT const valid = valid_mask(i);
+      ChunkT w = chunk.load(std::memory_order_relaxed);
+      while (ChunkT free = ~w & valid) {
+        ChunkT bit = free & (~free + 1);
+        if (chunk.compare_exchange_weak(w, w | bit, std::memory_order_acq_rel,
+                                        std::memory_order_relaxed))
+          return i * CHUNK_BITS + bitops::countr_zero(bit);
+      }
+    }
+    return self().size();
+  }
+
+  /* Relaxed snapshot; exact only when no other thread is writing */
+  std::size_t count() const noexcept
+  {
+    std::size_t cnt = 0;
+    for (std::size_t i = 0; i < self().chunk_count(); ++i)
+      cnt += bitops::popcount(
+          self().chunks()[i].load(std::memory_order_relaxed));
+    return cnt;
+  }
+  bool any() const noexcept
+  {
+    for (std::size_t i = 0; i < self().chunk_count(); ++i)
+      if (self().chunks()[i].load(std::memory_order_relaxed)) return true;
+    return false;
+  }
+  bool none() const noexcept { return !any(); }
+
+  /* Not atomic as a whole; each chunk is cleared with a release store */
+  void reset() noexcept
+  {
+    for (std::size_t i = 0; i < self().chunk_count(); ++i)
+      self().chunks()[i].store(0, std::memory_order_release);
+  }
+};
+} // namespace detail
+
+template <std::size_t N>
+class atomic_bitmap : public detail::atomic_bitmap_ops<atomic_bitmap<N>>
+{
+  friend detail::atomic_bitmap_ops<atomic_bitmap>;
+  using typename detail::atomic_bitmap_ops<atomic_bitmap>::ChunkT;
+  using detail::atomic_bitmap_ops<atomic_bitmap>::CHUNK_BITS;
+
+private:
+  constexpr static auto CHUNK_COUNT = (N + CHUNK_BITS - 1) / CHUNK_BITS;
+
+  std::array<std::atomic<ChunkT>, CHUNK_COUNT> _bit_array;
+
+  std::atomic<ChunkT> *chunks() { return _bit_array.data(); }
+  std::atomic<ChunkT> const *chunks() const { return _bit_array.data(); }
+  constexpr static std::size_t chunk_count() { return CHUNK_COUNT; }
+
+public:
+  atomic_bitmap() : _bit_array{} {}
+  atomic_bitmap(atomic_bitmap const &) = delete;
+  atomic_bitmap &operator=(atomic_bitmap const &) = delete;
+
+  constexpr std::size_t size() const { return N; }
+};
+
+class dynamic_atomic_bitmap
+    : public detail::atomic_bitmap_ops<dynamic_atomic_bitmap>
+{
+  friend detail::atomic_bitmap_ops<dynamic_atomic_bitmap>;
+
+private:
+  std::size_t _size;
+  std::unique_ptr<std::atomic<ChunkT>[]> _bit_vec;
+
+  std::atomic<ChunkT> *chunks() { return _bit_vec.get(); }
+  std::atomic<ChunkT> const *chunks() const { return _bit_vec.get(); }
+  std::size_t chunk_count() const
+  {
+    return (_size + CHUNK_BITS - 1) / CHUNK_BITS;
+  }
+
+public:
+  dynamic_atomic_bitmap(std::size_t size)
+      : _size(size), _bit_vec(new std::atomic<ChunkT>[chunk_count()]())
+  {
+  }
+
+  std::size_t size() const { return _size; }
+};
+} // namespace util
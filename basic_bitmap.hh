@@ -0,0 +1,709 @@
+/* Storage-independent core of bitmap, dynamic_bitmap and bitmap_view
+ *
+ * Every algorithm (single-bit access, bulk, range and shift operations,
+ * expression assignment, iteration) is written once here against a storage
+ * policy from bitmap_storage.hh, so kernel and SIMD paths apply to every kind
+ * of storage. With fixed storage the size is a constant and everything
+ * folds and stays constexpr.
+ *
+ * Derived is the concrete bitmap type; mutating operations return it.
+ */
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include "util/bit.hh"
+#include "util/bit_kernels.hh"
+#include "util/bitmap_expr.hh"
+#include "util/bitmap_storage.hh"
+#include "util/fitted_int.hh"
+
+namespace util
+{
+template <class Derived, class Storage>
+class basic_bitmap
+{
+public:
+  using id_type = typename Storage::id_type;
+  using chunk_type = typename Storage::chunk_type;
+
+private:
+  using ChunkT = chunk_type;
+  constexpr static auto CHUNK_BITS = std::numeric_limits<ChunkT>::digits;
+
+  friend struct bitmap_storage::access;
+  template <class, class>
+  friend class basic_bitmap;
+
+  /* Enables a member for another bitmap over the same chunk type, whatever
+   * its storage */
+  template <class B>
+  using enable_same_chunks = std::enable_if_t<
+      std::is_same<typename B::chunk_type, chunk_type>::value>;
+
+  /* Enables a member that copies the bitmap; a copy of a view would share
+   * its chunks */
+  template <class S>
+  using enable_owning = std::enable_if_t<!bitmap_storage::is_view<S>::value>;
+
+  constexpr Derived &self() { return static_cast<Derived &>(*this); }
+  constexpr Derived const &self() const
+  {
+    return static_cast<Derived const &>(*this);
+  }
+
+  constexpr auto chunks() { return _storage.data(); }
+  constexpr ChunkT const *chunks() const { return _storage.data(); }
+  constexpr std::size_t chunk_count() const { return _storage.chunk_count(); }
+  constexpr ChunkT pad_mask() const
+  {
+    return (ChunkT)((ChunkT)~(ChunkT)0 >>
+                    (CHUNK_BITS * chunk_count() - size()));
+  }
+
+  /* Bulk operations go to the vector kernels when the chunks are the
+   * kernels' type (known at compile time) and there are enough of them */
+  constexpr static bool KERNEL_CHUNKS =
+      std::is_same<ChunkT, kernels::chunk_t>::value;
+  constexpr bool use_kernels() const
+  {
+    return !kernels::is_constant_evaluated() &&
+           chunk_count() >= kernels::MIN_CHUNKS;
+  }
+
+  constexpr void check_index(std::size_t bit) const
+  {
+    if (bit >= size()) throw std::range_error("invalid index");
+  }
+  constexpr void check_range(std::size_t first, std::size_t last) const
+  {
+    if (first > last || last > size()) throw std::range_error("invalid range");
+  }
+
+  class BitId;
+
+  class ChunkId
+  {
+  private:
+    using T = id_type;
+    T _val;
+
+  public:
+    explicit constexpr ChunkId(T val) : _val(val) {}
+    constexpr ChunkId(BitId id) : _val(id / CHUNK_BITS){};
+    constexpr operator T &() { return _val; }
+    constexpr operator T const &() const { return _val; }
+  };
+
+  class ChunkOffset
+  {
+  private:
+    using T = fitted_int::uint_fastX_t<CHUNK_BITS>;
+    T _val;
+
+  public:
+    constexpr ChunkOffset(T val) : _val(val) {}
+    constexpr ChunkOffset(BitId id) : _val(id % CHUNK_BITS) {}
+    constexpr operator T &() { return _val; }
+    constexpr operator T const &() const { return _val; }
+  };
+
+  class BitId
+  {
+  private:
+    using T = id_type;
+    T _val;
+
+  public:
+    constexpr BitId(T val = 0) : _val(val) {}
+    constexpr BitId(ChunkId id, ChunkOffset offset)
+        : _val(id * CHUNK_BITS + offset)
+    {
+    }
+    constexpr operator T &() { return _val; }
+    constexpr operator T const &() const { return _val; }
+  };
+
+protected:
+  Storage _storage;
+
+  constexpr basic_bitmap() = default;
+  constexpr explicit basic_bitmap(Storage storage)
+      : _storage(std::move(storage))
+  {
+  }
+
+  constexpr void mask_tail()
+  {
+    if (chunk_count()) chunks()[chunk_count() - 1] &= pad_mask();
+  }
+
+  template <class Op, class E>
+  constexpr Derived &assign_expr(E const &expr, Op op) noexcept
+  {
+    auto *p = chunks();
+    for (std::size_t i = 0; i < chunk_count(); ++i)
+      p[i] = (ChunkT)op(p[i], expr.chunk(i));
+    mask_tail();
+    return self();
+  }
+
+public:
+  constexpr std::size_t size() const { return _storage.size(); }
+
+  constexpr Derived &set(BitId bit, bool val = true)
+  {
+    check_index(bit);
+    (*this)[bit] = val;
+    return self();
+  }
+
+  constexpr Derived &set() noexcept
+  {
+    auto *p = chunks();
+    for (std::size_t i = 0; i < chunk_count(); ++i) p[i] = ~(ChunkT)0;
+    mask_tail();
+    return self();
+  }
+
+  constexpr Derived &reset() noexcept
+  {
+    auto *p = chunks();
+    for (std::size_t i = 0; i < chunk_count(); ++i) p[i] = 0;
+    return self();
+  }
+  constexpr Derived &reset(BitId bit) { return set(bit, false); }
+
+  constexpr Derived &flip(BitId bit) { return set(bit, !test(bit)); }
+
+  constexpr Derived &flip() noexcept
+  {
+    auto *p = chunks();
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels()) {
+        kernels::active().flip(p, chunk_count());
+        mask_tail();
+        return self();
+      }
+    for (std::size_t i = 0; i < chunk_count(); ++i) p[i] = ~p[i];
+    mask_tail();
+    return self();
+  }
+
+  /* Range operations act on the half-open range [first, last). set() takes
+   * an explicit value: set(first, last) would silently bind to
+   * set(bit, val). */
+  constexpr Derived &set(BitId first, BitId last, bool val)
+  {
+    check_range(first, last);
+    kernels::range::fill(chunks(), first, last, val);
+    return self();
+  }
+  constexpr Derived &reset(BitId first, BitId last)
+  {
+    return set(first, last, false);
+  }
+  constexpr Derived &flip(BitId first, BitId last)
+  {
+    check_range(first, last);
+    kernels::range::flip(chunks(), first, last);
+    return self();
+  }
+  constexpr BitId count(BitId first, BitId last) const
+  {
+    check_range(first, last);
+    return kernels::range::count(chunks(), first, last);
+  }
+
+  constexpr Derived &operator<<=(std::size_t shift) noexcept
+  {
+    kernels::range::shift_up(chunks(), chunk_count(), shift);
+    mask_tail();
+    return self();
+  }
+  constexpr Derived &operator>>=(std::size_t shift) noexcept
+  {
+    kernels::range::shift_down(chunks(), chunk_count(), shift);
+    return self();
+  }
+  /* Not for views, whose copies would shift the viewed chunks; use <<= and
+   * >>= on those */
+  template <class S = Storage, class = enable_owning<S>>
+  constexpr Derived operator<<(std::size_t shift) const
+  {
+    return Derived(self()) <<= shift;
+  }
+  template <class S = Storage, class = enable_owning<S>>
+  constexpr Derived operator>>(std::size_t shift) const
+  {
+    return Derived(self()) >>= shift;
+  }
+
+  constexpr bool test(BitId bit) const
+  {
+    check_index(bit);
+    return (*this)[bit];
+  }
+
+  template <class D, class S, class = enable_same_chunks<S>>
+  constexpr bool operator==(basic_bitmap<D, S> const &other) const noexcept
+  {
+    return size() == other.size() &&
+           std::equal(chunks(), chunks() + chunk_count(), other.chunks());
+  }
+
+  template <class D, class S, class = enable_same_chunks<S>>
+  constexpr bool operator!=(basic_bitmap<D, S> const &other) const noexcept
+  {
+    return !(*this == other);
+  }
+
+  /* The other operand must be the same size */
+  template <class D, class S, class = enable_same_chunks<S>>
+  constexpr Derived &operator&=(basic_bitmap<D, S> const &other) noexcept
+  {
+    auto *p = chunks();
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels()) {
+        kernels::active().and_assign(p, other.chunks(), chunk_count());
+        return self();
+      }
+    for (std::size_t i = 0; i < chunk_count(); ++i) p[i] &= other.chunks()[i];
+    return self();
+  }
+  template <class D, class S, class = enable_same_chunks<S>>
+  constexpr Derived &operator|=(basic_bitmap<D, S> const &other) noexcept
+  {
+    auto *p = chunks();
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels()) {
+        kernels::active().or_assign(p, other.chunks(), chunk_count());
+        return self();
+      }
+    for (std::size_t i = 0; i < chunk_count(); ++i) p[i] |= other.chunks()[i];
+    return self();
+  }
+  template <class D, class S, class = enable_same_chunks<S>>
+  constexpr Derived &operator^=(basic_bitmap<D, S> const &other) noexcept
+  {
+    auto *p = chunks();
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels()) {
+        kernels::active().xor_assign(p, other.chunks(), chunk_count());
+        return self();
+      }
+    for (std::size_t i = 0; i < chunk_count(); ++i) p[i] ^= other.chunks()[i];
+    return self();
+  }
+
+  template <class E, class = bitmap_expr::enable_for<E, Derived>>
+  constexpr Derived &operator&=(E const &expr) noexcept
+  {
+    return assign_expr(expr, std::bit_and<>());
+  }
+  template <class E, class = bitmap_expr::enable_for<E, Derived>>
+  constexpr Derived &operator|=(E const &expr) noexcept
+  {
+    return assign_expr(expr, std::bit_or<>());
+  }
+  template <class E, class = bitmap_expr::enable_for<E, Derived>>
+  constexpr Derived &operator^=(E const &expr) noexcept
+  {
+    return assign_expr(expr, std::bit_xor<>());
+  }
+
+  constexpr bool any() const noexcept
+  {
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels())
+        return kernels::active().any(chunks(), chunk_count());
+    for (std::size_t i = 0; i < chunk_count(); ++i)
+      if (chunks()[i]) return true;
+    return false;
+  }
+  constexpr bool none() const noexcept { return !any(); }
+  constexpr bool all() const noexcept
+  {
+    std::size_t const n = chunk_count();
+    if (n == 0) return true;
+    if (chunks()[n - 1] != pad_mask()) return false;
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels()) return kernels::active().all(chunks(), n - 1);
+    for (std::size_t i = 0; i < n - 1; ++i)
+      if ((ChunkT)~chunks()[i]) return false;
+    return true;
+  }
+
+  /* (*this & other).any(), stopping at the first common bit. The other
+   * operand must be the same size. */
+  template <class D, class S, class = enable_same_chunks<S>>
+  constexpr bool intersects(basic_bitmap<D, S> const &other) const noexcept
+  {
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels())
+        return kernels::active().intersects(chunks(), other.chunks(),
+                                            chunk_count());
+    for (std::size_t i = 0; i < chunk_count(); ++i)
+      if (chunks()[i] & other.chunks()[i]) return true;
+    return false;
+  }
+
+  constexpr BitId count() const noexcept
+  {
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels())
+        return kernels::active().count(chunks(), chunk_count());
+    BitId cnt = 0;
+    for (std::size_t i = 0; i < chunk_count(); ++i)
+      cnt += bitops::popcount(chunks()[i]);
+    return cnt;
+  }
+
+  /* Calls f(i) for every set bit i, in increasing order. Much cheaper than
+   * iterating: no bounds checks, one countr_zero and one blsr per bit. */
+  template <class F>
+  constexpr void for_each_set_bit(F f) const
+  {
+    for (std::size_t i = 0; i < chunk_count(); ++i) {
+      std::size_t const base = i * CHUNK_BITS;
+      for (ChunkT w = chunks()[i]; w; w &= (ChunkT)(w - 1))
+        f(base + bitops::countr_zero(w));
+    }
+  }
+
+  /* Writes the indices of the set bits, in increasing order, to out and
+   * returns how many (i.e. count()); out must have room for them. Indices
+   * must fit in 32 bits. */
+  constexpr std::size_t decode_into(std::uint32_t *out) const noexcept
+  {
+    if constexpr (KERNEL_CHUNKS)
+      if (use_kernels())
+        return kernels::active().decode(chunks(), chunk_count(), out);
+    std::uint32_t *o = out;
+    for_each_set_bit([&](std::size_t i) { *o++ = (std::uint32_t)i; });
+    return o - out;
+  }
+
+private:
+  /* First chunk at or after i that is nonzero (Zero: not all ones), or
+   * chunk_count(). The nearest chunks are checked inline, since a hit is
+   * usually close; the kernels take over for long runs. */
+  template <bool Zero>
+  constexpr std::size_t scan_forward(std::size_t i) const noexcept
+  {
+    std::size_t const n = chunk_count();
+    for (std::size_t const stop = std::min(n, i + kernels::MIN_CHUNKS);
+         i < stop; ++i)
+      if ((ChunkT)(Zero ? ~chunks()[i] : chunks()[i])) return i;
+    if constexpr (KERNEL_CHUNKS)
+      if (!kernels::is_constant_evaluated() && i < n)
+        return i + (Zero ? kernels::active().find_not_ones(chunks() + i, n - i)
+                         : kernels::active().find_nonzero(chunks() + i, n - i));
+    for (; i < n; ++i)
+      if ((ChunkT)(Zero ? ~chunks()[i] : chunks()[i])) break;
+    return i;
+  }
+
+  /* Last nonzero chunk before i, or chunk_count() */
+  constexpr std::size_t scan_backward(std::size_t i) const noexcept
+  {
+    for (std::size_t const stop = i - std::min(i, kernels::MIN_CHUNKS);
+         i > stop;)
+      if (chunks()[--i]) return i;
+    if constexpr (KERNEL_CHUNKS)
+      if (!kernels::is_constant_evaluated() && i) {
+        std::size_t const r = kernels::active().rfind_nonzero(chunks(), i);
+        return r == i ? chunk_count() : r;
+      }
+    while (i-- > 0)
+      if (chunks()[i]) return i;
+    return chunk_count();
+  }
+
+  /* First set (Zero: clear) bit at or after bit, or size() */
+  template <bool Zero>
+  constexpr std::size_t find_from(std::size_t bit) const noexcept
+  {
+    if (bit >= size()) return size();
+    std::size_t i = bit / CHUNK_BITS;
+    ChunkT w = Zero ? (ChunkT)~chunks()[i] : chunks()[i];
+    w = (ChunkT)(w >> (bit % CHUNK_BITS));
+    if (!w) {
+      i = scan_forward<Zero>(i + 1);
+      if (i == chunk_count()) return size();
+      bit = i * CHUNK_BITS;
+      w = Zero ? (ChunkT)~chunks()[i] : chunks()[i];
+    }
+    /* A clear padding bit is not a clear bit of the bitmap */
+    return std::min<std::size_t>(bit + bitops::countr_zero(w), size());
+  }
+
+  /* Last set bit before bit (<= size()), or size() */
+  constexpr std::size_t find_before(std::size_t bit) const noexcept
+  {
+    if (bit == 0) return size();
+    std::size_t const i = (bit - 1) / CHUNK_BITS;
+    std::size_t const off = (bit - 1) % CHUNK_BITS;
+    ChunkT const w = (ChunkT)(chunks()[i] << (CHUNK_BITS - 1 - off));
+    if (w) return bit - 1 - bitops::countl_zero(w);
+    std::size_t const j = scan_backward(i);
+    if (j == chunk_count()) return size();
+    return (j + 1) * CHUNK_BITS - 1 - bitops::countl_zero(chunks()[j]);
+  }
+
+public:
+  /* Positional search. find_next(pos) and find_prev(pos) look strictly
+   * after or before pos. All return size() when there is no such bit. Whole
+   * zero (or all-ones) chunks are skipped with the vector kernels. */
+  constexpr std::size_t find_first() const noexcept
+  {
+    return find_from<false>(0);
+  }
+  constexpr std::size_t find_next(std::size_t pos) const noexcept
+  {
+    return pos >= size() ? size() : find_from<false>(pos + 1);
+  }
+  constexpr std::size_t find_last() const noexcept
+  {
+    return find_before(size());
+  }
+  constexpr std::size_t find_prev(std::size_t pos) const noexcept
+  {
+    return find_before(std::min<std::size_t>(pos, size()));
+  }
+  constexpr std::size_t find_first_zero() const noexcept
+  {
+    return find_from<true>(0);
+  }
+  constexpr std::size_t find_next_zero(std::size_t pos) const noexcept
+  {
+    return pos >= size() ? size() : find_from<true>(pos + 1);
+  }
+
+  class bit_proxy
+  {
+    friend basic_bitmap;
+
+  private:
+    ChunkT &_chunk;
+    ChunkT _mask;
+    constexpr bit_proxy(ChunkT &chunk, ChunkT mask) : _chunk(chunk), _mask(mask)
+    {
+    }
+    constexpr bit_proxy(ChunkT &chunk, ChunkOffset offset)
+        : _chunk(chunk), _mask(ChunkT(1) << offset)
+    {
+    }
+
+  public:
+    constexpr operator bool() const noexcept { return _chunk & _mask; }
+    constexpr bit_proxy &operator=(bool val) noexcept
+    {
+      if (val) _chunk |= _mask;
+      else _chunk &= ~_mask;
+      return *this;
+    }
+    constexpr bool operator~() const noexcept { return !*this; }
+    constexpr bit_proxy &flip() noexcept { return *this = ~*this; }
+  };
+
+public:
+  constexpr bit_proxy operator[](BitId id)
+  {
+    return bit_proxy(chunks()[ChunkId(id)], ChunkOffset(id));
+  }
+  constexpr bool operator[](BitId id) const
+  {
+    ChunkT mask = ChunkT(1) << ChunkOffset(id);
+    return (bool)(ChunkT)(chunks()[ChunkId(id)] & mask);
+  }
+
+  class biterator
+  {
+    friend basic_bitmap;
+
+  public:
+    using difference_type = BitId;
+    using value_type = BitId;
+    using pointer = value_type *;
+    using reference = value_type;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+  private:
+    basic_bitmap &_ref;
+    ChunkId _id;
+    ChunkOffset _offset;
+    constexpr biterator(basic_bitmap &ref, ChunkId id, ChunkOffset offset)
+        : _ref(ref), _id(id), _offset(offset)
+    {
+    }
+    /* Bit index, past size() at end() (so not a BitId, which may not hold
+     * it) */
+    constexpr std::size_t pos() const
+    {
+      return (std::size_t)_id * CHUNK_BITS + _offset;
+    }
+    /* To the set bit at pos, or to end() when pos is size() */
+    constexpr void seek(std::size_t pos)
+    {
+      if (pos < _ref.size()) {
+        _id = ChunkId(BitId(pos));
+        _offset = ChunkOffset(BitId(pos));
+      } else {
+        _id = ChunkId(_ref.chunk_count());
+        _offset = 0;
+      }
+    }
+
+  public:
+    constexpr reference operator*() { return reference(_id, _offset); }
+
+    constexpr biterator &operator++()
+    {
+      if (_id >= _ref.chunk_count())
+        throw std::range_error("iterate past end");
+      /* The rest of this chunk first */
+      ChunkT const w = _offset + 1 < CHUNK_BITS
+                           ? (ChunkT)(_ref.chunks()[_id] >> (_offset + 1))
+                           : 0;
+      if (w) {
+        _offset += bitops::countr_zero(w) + 1;
+      } else {
+        std::size_t const i = _ref.template scan_forward<false>(_id + 1);
+        _id = ChunkId(i);
+        _offset = i < _ref.chunk_count()
+                      ? bitops::countr_zero(_ref.chunks()[i])
+                      : 0; /* end() */
+      }
+      return *this;
+    }
+    constexpr biterator operator++(int)
+    {
+      biterator ret = *this;
+      ++*this;
+      return ret;
+    }
+
+    constexpr biterator &operator--()
+    {
+      std::size_t const prev = _ref.find_prev(pos());
+      if (prev == _ref.size()) throw std::range_error("iterate before begin");
+      seek(prev);
+      return *this;
+    }
+    constexpr biterator operator--(int)
+    {
+      biterator ret = *this;
+      --*this;
+      return ret;
+    }
+
+    constexpr bool operator==(biterator const &other) const noexcept
+    {
+      return std::addressof(_ref) == std::addressof(other._ref) &&
+             _id == other._id && _offset == other._offset;
+    }
+    constexpr bool operator!=(biterator const &other) const noexcept
+    {
+      return !operator==(other);
+    }
+  };
+
+  constexpr biterator begin()
+  {
+    biterator it = end();
+    it.seek(find_first());
+    return it;
+  }
+
+  constexpr biterator end()
+  {
+    return biterator(*this, ChunkId(chunk_count()), 0);
+  }
+
+  /* Set bits from the highest down; also what adaptor::reverse uses */
+  using reverse_iterator = std::reverse_iterator<biterator>;
+  constexpr reverse_iterator rbegin() { return reverse_iterator(end()); }
+  constexpr reverse_iterator rend() { return reverse_iterator(begin()); }
+
+  /* Most significant (highest index) bit first, as std::bitset */
+  template <class CharT = char, class Traits = std::char_traits<CharT>,
+            class Allocator = std::allocator<CharT>>
+  std::basic_string<CharT, Traits, Allocator>
+  to_string(CharT zero = CharT('0'), CharT one = CharT('1')) const
+  {
+    std::basic_string<CharT, Traits, Allocator> ret(size(), zero);
+    if constexpr (std::is_same<CharT, char>::value) {
+      kernels::text::to_binary(chunks(), chunk_count(), size(), &ret[0], zero,
+                               one);
+    } else {
+      for (std::size_t i = 0; i < chunk_count(); ++i)
+        for (ChunkT chunk = chunks()[i]; chunk; chunk &= chunk - 1)
+          ret[size() - 1 - (i * CHUNK_BITS + bitops::countr_zero(chunk))] =
+              one;
+    }
+    return ret;
+  }
+
+  /* Digits to_chars writes in base 2 or 16 */
+  constexpr std::size_t chars_size(int base = 2) const noexcept
+  {
+    return base == 16 ? (size() + 3) / 4 : size();
+  }
+
+  /* Writes chars_size(base) digits in base 2 or 16, most significant first,
+   * without a terminator. As std::to_chars, returns value_too_large (and
+   * last) if they don't fit. */
+  std::to_chars_result to_chars(char *first, char *last, int base = 2,
+                                bool uppercase = false) const
+  {
+    if (base != 2 && base != 16) return {first, std::errc::invalid_argument};
+    std::size_t const n = chars_size(base);
+    if ((std::size_t)(last - first) < n)
+      return {last, std::errc::value_too_large};
+    if (base == 2)
+      kernels::text::to_binary(chunks(), chunk_count(), size(), first, '0',
+                               '1');
+    else
+      kernels::text::to_hex(chunks(), chunk_count(), size(), first,
+                            uppercase);
+    return {first + n, std::errc()};
+  }
+
+  /* Assigns the run of base 2 or 16 digits at first, read as a number (so
+   * shorter runs fill the low bits). As std::from_chars, returns
+   * invalid_argument if there is no digit and result_out_of_range if the
+   * number needs more than size() bits, and leaves *this unchanged then. */
+  std::from_chars_result from_chars(char const *first, char const *last,
+                                    int base = 2)
+  {
+    bool const hex = base == 16;
+    if (base != 2 && !hex) return {first, std::errc::invalid_argument};
+    char const *const end =
+        first + (hex ? kernels::text::hex_span(first, last)
+                     : kernels::text::binary_span(first, last, '0', '1'));
+    if (end == first) return {first, std::errc::invalid_argument};
+    std::size_t const max = chars_size(base);
+    char const *p = first;
+    while ((std::size_t)(end - p) > max && *p == '0') ++p;
+    std::size_t const n = end - p;
+    if (n > max || (hex && n == max && size() % 4 &&
+                    kernels::text::hex_value(*p) >> (size() % 4)))
+      return {end, std::errc::result_out_of_range};
+    if (hex)
+      kernels::text::from_hex(p, n, chunks(), chunk_count());
+    else
+      kernels::text::from_binary(p, n, chunks(), chunk_count(), '0', '1');
+    return {end, std::errc()};
+  }
+};
+} // namespace util
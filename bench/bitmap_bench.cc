@@ -0,0 +1,426 @@
+/* Benchmarks behind the performance claims in bitmap.hh and ring_buffer.hh
+ *
+ * Compares bitmap<N>, dynamic_bitmap, std::bitset<N> and std::vector<bool>
+ * across sizes and densities on single-bit set/test, bulk &=, count(),
+ * iteration over set bits (also libstdc++'s std::bitset::_Find_next) and
+ * copying; and ring_buffer against std::deque
+ * as a FIFO. Every case is timed as the best of several repetitions of a
+ * loop long enough to swamp the clock, and reported in ns per operation
+ * (per bit access, per whole-bitmap operation, per set bit visited, or per
+ * element pushed and popped).
+ *
+ * Usage: bitmap_bench [--json FILE] [--quick] [--filter SUBSTRING]
+ *
+ * Without --json, prints a table; with it, also writes every result as JSON
+ * for comparison between releases. --quick cuts the timing budget for smoke
+ * runs; --filter keeps the cases whose "benchmark/impl" name contains
+ * SUBSTRING.
+ */
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util/bitmap.hh"
+#include "util/ring_buffer.hh"
+
+namespace
+{
+struct options {
+  char const *json = nullptr;
+  char const *filter = nullptr;
+  double budget_ns = 20e6; /* per repetition */
+  int repetitions = 5;
+};
+options opts;
+
+struct result {
+  std::string benchmark;
+  std::string impl;
+  std::size_t size;
+  double density;
+  double ns_per_op;
+};
+std::vector<result> results;
+
+/* Keeps the compiler from discarding an object or the stores leading to it:
+ * its address escapes into code that may read any memory */
+template <class T>
+inline void
+keep(T const &value)
+{
+#if defined(__GNUC__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static void const *volatile sink;
+  sink = &value;
+#endif
+}
+
+bool
+selected(char const *benchmark, char const *impl)
+{
+  if (!opts.filter) return true;
+  return (std::string(benchmark) + "/" + impl).find(opts.filter) !=
+         std::string::npos;
+}
+
+/* Best-of-N ns per op of f(), which does ops operations per call */
+template <class F>
+double
+time_ns(F &&f, std::size_t ops)
+{
+  using clock = std::chrono::steady_clock;
+  std::size_t calls = 1;
+  for (;;) { /* calibrate */
+    auto start = clock::now();
+    for (std::size_t i = 0; i < calls; ++i) f();
+    double ns = std::chrono::duration<double, std::nano>(clock::now() - start)
+                    .count();
+    if (ns >= opts.budget_ns / 10 || calls >= (std::size_t(1) << 24)) break;
+    calls *= 2;
+  }
+  calls = std::max<std::size_t>(1, calls * 10);
+  double best = 1e300;
+  for (int r = 0; r < opts.repetitions; ++r) {
+    auto start = clock::now();
+    for (std::size_t i = 0; i < calls; ++i) f();
+    double ns = std::chrono::duration<double, std::nano>(clock::now() - start)
+                    .count();
+    best = std::min(best, ns / (double(calls) * double(ops)));
+  }
+  return best;
+}
+
+template <class F>
+void
+run(char const *benchmark, char const *impl, std::size_t size,
+    double density, std::size_t ops, F &&f)
+{
+  if (!selected(benchmark, impl)) return;
+  double ns = time_ns(f, std::max<std::size_t>(1, ops));
+  results.push_back({benchmark, impl, size, density, ns});
+  std::printf("%-10s %-14s %9zu %6.2f %12.3f\n", benchmark, impl, size,
+              density, ns);
+}
+
+/* Uniform access to the four bitmap types */
+template <class B>
+struct bits;
+
+template <std::size_t N>
+struct bits<util::bitmap<N>> {
+  constexpr static char const *name = "bitmap<N>";
+  static std::unique_ptr<util::bitmap<N>> make(std::size_t)
+  {
+    return std::make_unique<util::bitmap<N>>();
+  }
+  static void set(util::bitmap<N> &b, std::size_t i) { b.set(i); }
+  static bool test(util::bitmap<N> const &b, std::size_t i)
+  {
+    return b.test(i);
+  }
+  static std::size_t sum_set(util::bitmap<N> &b)
+  {
+    std::size_t sum = 0;
+    for (auto i : b) sum += i;
+    return sum;
+  }
+};
+
+template <>
+struct bits<util::dynamic_bitmap> {
+  constexpr static char const *name = "dynamic_bitmap";
+  static std::unique_ptr<util::dynamic_bitmap> make(std::size_t n)
+  {
+    return std::make_unique<util::dynamic_bitmap>(n);
+  }
+  static void set(util::dynamic_bitmap &b, std::size_t i) { b.set(i); }
+  static bool test(util::dynamic_bitmap const &b, std::size_t i)
+  {
+    return b.test(i);
+  }
+  static std::size_t sum_set(util::dynamic_bitmap &b)
+  {
+    std::size_t sum = 0;
+    for (auto i : b) sum += i;
+    return sum;
+  }
+};
+
+template <std::size_t N>
+struct bits<std::bitset<N>> {
+  constexpr static char const *name = "std::bitset";
+  static std::unique_ptr<std::bitset<N>> make(std::size_t)
+  {
+    return std::make_unique<std::bitset<N>>();
+  }
+  static void set(std::bitset<N> &b, std::size_t i) { b.set(i); }
+  static bool test(std::bitset<N> const &b, std::size_t i) { return b.test(i); }
+  static std::size_t sum_set(std::bitset<N> &b)
+  {
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < N; ++i)
+      if (b[i]) sum += i;
+    return sum;
+  }
+};
+
+template <>
+struct bits<std::vector<bool>> {
+  constexpr static char const *name = "vector<bool>";
+  static std::unique_ptr<std::vector<bool>> make(std::size_t n)
+  {
+    return std::make_unique<std::vector<bool>>(n);
+  }
+  static void set(std::vector<bool> &b, std::size_t i) { b[i] = true; }
+  static bool test(std::vector<bool> const &b, std::size_t i) { return b[i]; }
+  static std::size_t sum_set(std::vector<bool> &b)
+  {
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < b.size(); ++i)
+      if (b[i]) sum += i;
+    return sum;
+  }
+};
+
+/* Bulk &= and count() use each type's own operations */
+template <class B>
+void
+and_assign(B &a, B const &b)
+{
+  a &= b;
+}
+void
+and_assign(std::vector<bool> &a, std::vector<bool> const &b)
+{
+  for (std::size_t i = 0; i < a.size(); ++i) a[i] = a[i] && b[i];
+}
+template <class B>
+std::size_t
+count(B const &b)
+{
+  return b.count();
+}
+std::size_t
+count(std::vector<bool> const &b)
+{
+  return std::count(b.begin(), b.end(), true);
+}
+
+template <class B>
+void
+bench_bitmap(std::size_t n, double density)
+{
+  using T = bits<B>;
+  std::mt19937_64 rng(n);
+  std::bernoulli_distribution coin(density);
+  auto a = T::make(n), b = T::make(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (coin(rng)) T::set(*a, i);
+    if (coin(rng)) T::set(*b, i);
+  }
+  std::size_t set_bits = count(*a);
+
+  constexpr std::size_t ACCESSES = 1024;
+  std::vector<std::uint32_t> idx(ACCESSES);
+  for (auto &i : idx) i = rng() % n;
+
+  run("set", T::name, n, density, ACCESSES, [&] {
+    for (auto i : idx) T::set(*a, i);
+    keep(*a);
+  });
+  run("test", T::name, n, density, ACCESSES, [&] {
+    std::size_t hits = 0;
+    for (auto i : idx) hits += T::test(*a, i);
+    keep(hits);
+  });
+  run("and", T::name, n, density, 1, [&] {
+    and_assign(*a, *b);
+    keep(*a);
+  });
+  run("count", T::name, n, density, 1, [&] { keep(count(*b)); });
+  run("iterate", T::name, n, density, std::max<std::size_t>(1, count(*b)),
+      [&] { keep(T::sum_set(*b)); });
+  run("copy", T::name, n, density, 1, [&] {
+    B copy(*b);
+    keep(copy);
+  });
+  keep(set_bits);
+}
+
+void
+bench_for_each(std::size_t n, double density)
+{
+  std::mt19937_64 rng(n);
+  std::bernoulli_distribution coin(density);
+  util::dynamic_bitmap b(n);
+  for (std::size_t i = 0; i < n; ++i)
+    if (coin(rng)) b.set(i);
+  std::size_t const set_bits = std::max<std::size_t>(1, b.count());
+  std::vector<std::uint32_t> out(set_bits);
+  run("for_each", "dynamic_bitmap", n, density, set_bits, [&] {
+    std::size_t sum = 0;
+    b.for_each_set_bit([&](std::size_t i) { sum += i; });
+    keep(sum);
+  });
+  run("decode", "dynamic_bitmap", n, density, set_bits, [&] {
+    keep(b.decode_into(out.data()));
+    keep(out[0]);
+  });
+}
+
+#ifdef __GLIBCXX__
+/* libstdc++'s word-at-a-time search, the fastest way through a std::bitset */
+template <std::size_t N>
+void
+bench_find_next(double density)
+{
+  std::mt19937_64 rng(N);
+  std::bernoulli_distribution coin(density);
+  auto b = std::make_unique<std::bitset<N>>();
+  for (std::size_t i = 0; i < N; ++i)
+    if (coin(rng)) b->set(i);
+  run("find_next", "std::bitset", N, density,
+      std::max<std::size_t>(1, b->count()), [&] {
+        std::size_t sum = 0;
+        for (std::size_t i = b->_Find_first(); i < N; i = b->_Find_next(i))
+          sum += i;
+        keep(sum);
+      });
+}
+#endif
+
+template <std::size_t N>
+void
+bench_size()
+{
+  for (double density : {0.01, 0.5}) {
+    bench_bitmap<util::bitmap<N>>(N, density);
+    bench_bitmap<util::dynamic_bitmap>(N, density);
+    bench_bitmap<std::bitset<N>>(N, density);
+    bench_bitmap<std::vector<bool>>(N, density);
+    bench_for_each(N, density);
+#ifdef __GLIBCXX__
+    bench_find_next<N>(density);
+#endif
+  }
+}
+
+/* FIFO throughput at a steady fill of half the capacity */
+template <class Queue>
+void
+bench_queue(char const *impl, Queue &q, std::size_t capacity)
+{
+  for (std::uint64_t i = 0; i < capacity / 2; ++i) q.push_back(i);
+  constexpr std::size_t OPS = 1024;
+  run("fifo", impl, capacity, 0, OPS, [&] {
+    for (std::uint64_t i = 0; i < OPS; ++i) {
+      q.push_back(i);
+      keep(q.front());
+      q.pop_front();
+    }
+  });
+}
+
+/* The std::deque interface over ring_buffer */
+template <std::size_t N>
+struct ring_fifo {
+  util::ring_buffer<std::uint64_t, N> buf;
+  void push_back(std::uint64_t v) { buf.push(v); }
+  std::uint64_t front() const { return buf.front(); }
+  void pop_front() { buf.pop(); }
+};
+
+void
+bench_queues()
+{
+  constexpr std::size_t CAPACITY = 1024;
+  auto ring = std::make_unique<ring_fifo<CAPACITY>>();
+  std::deque<std::uint64_t> deque;
+  bench_queue("ring_buffer", *ring, CAPACITY);
+  bench_queue("std::deque", deque, CAPACITY);
+}
+
+char const *
+kernels_name()
+{
+  switch (util::kernels::active().level) {
+  case util::kernels::isa::avx512:
+    return "avx512";
+  case util::kernels::isa::avx2:
+    return "avx2";
+  case util::kernels::isa::sse2:
+    return "sse2";
+  default:
+    return "scalar";
+  }
+}
+
+void
+write_json(char const *path)
+{
+  std::FILE *f = std::fopen(path, "w");
+  if (!f) {
+    std::perror(path);
+    std::exit(EXIT_FAILURE);
+  }
+  std::fprintf(f, "{\n  \"suite\": \"bitmap_bench\",\n");
+  std::fprintf(f, "  \"kernels\": \"%s\",\n", kernels_name());
+  std::fprintf(f, "  \"cplusplus\": %ld,\n", (long)__cplusplus);
+#if defined(__VERSION__)
+  std::fprintf(f, "  \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+  std::fprintf(f, "  \"results\": [");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    result const &r = results[i];
+    std::fprintf(f,
+                 "%s\n    {\"benchmark\": \"%s\", \"impl\": \"%s\", "
+                 "\"size\": %zu, \"density\": %g, \"ns_per_op\": %.4f}",
+                 i ? "," : "", r.benchmark.c_str(), r.impl.c_str(), r.size,
+                 r.density, r.ns_per_op);
+  }
+  std::fprintf(f, "\n  ]\n}\n");
+  std::fclose(f);
+}
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--json") && i + 1 < argc) {
+      opts.json = argv[++i];
+    } else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc) {
+      opts.filter = argv[++i];
+    } else if (!std::strcmp(argv[i], "--quick")) {
+      opts.budget_ns = 1e6;
+      opts.repetitions = 2;
+    } else {
+      std::fprintf(stderr,
+                   "usage: %s [--json FILE] [--quick] [--filter SUBSTRING]\n",
+                   argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::printf("%-10s %-14s %9s %6s %12s\n", "benchmark", "impl", "size",
+              "dens", "ns/op");
+  bench_size<64>();
+  bench_size<256>();
+  bench_size<512>();
+  bench_size<4096>();
+  bench_size<65536>();
+  bench_size<1048576>();
+  bench_queues();
+
+  if (opts.json) write_json(opts.json);
+}
@@ -0,0 +1,100 @@
+/* Contention benchmark for mpmc_queue
+ *
+ * Each of T threads (T = 1, 2, 4, ..., 64) runs the same number of
+ * push/pop pairs against one shared queue; reports aggregate pairs per
+ * second. A std::mutex around ring_buffer is measured alongside as the
+ * baseline the queue replaces.
+ *
+ * Usage: mpmc_queue_bench [pairs per thread]
+ */
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/mpmc_queue.hh"
+#include "util/ring_buffer.hh"
+
+namespace
+{
+constexpr std::size_t CAPACITY = 1024;
+
+class locked_ring_buffer
+{
+private:
+  std::mutex _lock;
+  util::ring_buffer<std::uint64_t, CAPACITY> _buf;
+
+public:
+  bool try_push(std::uint64_t v)
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_buf.size() == _buf.capacity()) return false;
+    _buf.push(v);
+    return true;
+  }
+  bool try_pop(std::uint64_t &v)
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_buf.empty()) return false;
+    v = _buf.front();
+    _buf.pop();
+    return true;
+  }
+};
+
+/* Returns pairs per second; checks every pushed value is popped once */
+template <class Queue>
+double
+run(unsigned threads, std::uint64_t pairs)
+{
+  auto queue = std::make_unique<Queue>();
+  std::atomic<unsigned> ready{0};
+  std::atomic<std::uint64_t> checksum{0};
+  std::vector<std::thread> pool;
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      ++ready;
+      while (ready < threads) std::this_thread::yield();
+      std::uint64_t sum = 0, v;
+      for (std::uint64_t i = 0; i < pairs; ++i) {
+        while (!queue->try_push(t * pairs + i)) std::this_thread::yield();
+        while (!queue->try_pop(v)) std::this_thread::yield();
+        sum += v;
+      }
+      checksum += sum;
+    });
+  }
+  for (auto &th : pool) th.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::uint64_t total = threads * pairs;
+  if (checksum != total * (total - 1) / 2) {
+    std::fprintf(stderr, "checksum mismatch at %u threads\n", threads);
+    std::exit(EXIT_FAILURE);
+  }
+  return total / elapsed.count();
+}
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+  std::uint64_t pairs = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+
+  std::printf("%8s %16s %16s\n", "threads", "mpmc_queue", "mutex+ring");
+  for (unsigned threads = 1; threads <= 64; threads *= 2) {
+    double lockfree =
+        run<util::mpmc_queue<std::uint64_t, CAPACITY>>(threads, pairs);
+    double locked = run<locked_ring_buffer>(threads, pairs);
+    std::printf("%8u %16.0f %16.0f\n", threads, lockfree, locked);
+  }
+}
@@ -1,10 +1,14 @@
 /* Portable <bit> implementation
  *
- * Tested with gcc 13.1 -O3 -std=c++11
- * Output assembly is identical between portable implementation and library
- * methods
+ * Uses <bit> when the library has it. Otherwise (before C++20) the same
+ * functions are built on compiler builtins, MSVC intrinsics, or de Bruijn
+ * and SWAR sequences, so they stay constant-time and constexpr; with GCC and
+ * Clang nearly everything compiles to single instructions either way.
  *
- * Mostly everything compiles to single-instructions
+ * Beyond <bit>: byteswap, bit_reverse, blsr/blsi, pdep/pext,
+ * select_in_word and 2D/3D Morton (Z-order) codes. These use BMI2 and the
+ * compiler's byte and bit reversal builtins when the target has them and
+ * portable broadword code otherwise; all are constexpr.
  *
  * Author: Ryan Gambord <Ryan.Gambord@oregonstate.edu>
  * Date: July 26 2023
@@ -33,8 +37,16 @@ using std::rotr;
 #else
 #include <array>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <type_traits>
+
+#if defined(_MSC_VER) && !defined(__clang__) && _MSC_VER >= 1925 &&         \
+    (defined(_M_X64) || defined(_M_ARM64))
+#include <intrin.h>
+#define UTIL_BITOPS_MSVC 1
+#endif
+
 namespace util
 {
 namespace bitops
@@ -45,94 +57,502 @@ using std::byte;
 enum class byte : unsigned char {};
 #endif
 
+/* Building blocks on one 64-bit word, x != 0 where noted. GCC and Clang
+ * builtins are constexpr and compile to one instruction (or a short
+ * sequence off x86); MSVC's intrinsics are used outside constant
+ * evaluation; everything else gets de Bruijn multiplication and SWAR, which
+ * are branch-free and constexpr. */
+namespace detail
+{
+constexpr std::uint64_t DEBRUIJN64 = 0x03f79d71b4cb0a89;
+constexpr std::array<unsigned char, 64> DEBRUIJN64_INDEX = {
+    0,  1,  48, 2,  57, 49, 28, 3,  61, 58, 50, 42, 38, 29, 17, 4,
+    62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+    63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+    46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9,  13, 8,  7,  6};
+
+/* Index of the only set bit of x */
+constexpr int
+single_bit_index(std::uint64_t x) noexcept
+{
+  return DEBRUIJN64_INDEX[(x * DEBRUIJN64) >> 58];
+}
+
+constexpr int
+ctz64(std::uint64_t x) noexcept /* x != 0 */
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+#if UTIL_BITOPS_MSVC
+  if (!__builtin_is_constant_evaluated()) {
+    unsigned long i = 0;
+    _BitScanForward64(&i, x);
+    return (int)i;
+  }
+#endif
+  return single_bit_index(x & (0 - x));
+#endif
+}
+
+constexpr int
+clz64(std::uint64_t x) noexcept /* x != 0 */
+{
+#if defined(__GNUC__)
+  return __builtin_clzll(x);
+#else
+#if UTIL_BITOPS_MSVC
+  if (!__builtin_is_constant_evaluated()) {
+    unsigned long i = 0;
+    _BitScanReverse64(&i, x);
+    return 63 - (int)i;
+  }
+#endif
+  /* Smear the top bit down, then isolate it */
+  x |= x >> 1;
+  x |= x >> 2;
+  x |= x >> 4;
+  x |= x >> 8;
+  x |= x >> 16;
+  x |= x >> 32;
+  return 63 - single_bit_index(x ^ (x >> 1));
+#endif
+}
+
+constexpr int
+popcount64(std::uint64_t x) noexcept
+{
+  /* Without -mpopcnt the builtin is a libgcc call, slower than SWAR */
+#if defined(__GNUC__) && defined(__POPCNT__)
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555);
+  x = (x & 0x3333333333333333) + ((x >> 2) & 0x3333333333333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0f;
+  return (int)((x * 0x0101010101010101) >> 56);
+#endif
+}
+
+template <typename T>
+using fits_word = std::integral_constant<bool, std::numeric_limits<T>::digits <=
+                                                   64>;
+
+/* Types of up to 64 bits widen to one word; wider ones (unsigned __int128)
+ * go a word at a time */
+template <typename T>
+constexpr int
+countr_zero(T x, std::true_type) noexcept
+{
+  return ctz64(x);
+}
+template <typename T>
+constexpr int
+countr_zero(T x, std::false_type) noexcept
+{
+  int n = 0;
+  for (; !(std::uint64_t)x; x >>= 64) n += 64;
+  return n + ctz64((std::uint64_t)x);
+}
+
+template <typename T>
+constexpr int
+countl_zero(T x, std::true_type) noexcept
+{
+  return clz64(x) - (64 - std::numeric_limits<T>::digits);
+}
+template <typename T>
+constexpr int
+countl_zero(T x, std::false_type) noexcept
+{
+  int n = std::numeric_limits<T>::digits - 64;
+  for (; x >> 64; x >>= 64) n -= 64;
+  return n + clz64((std::uint64_t)x);
+}
+
+template <typename T>
+constexpr int
+popcount(T x, std::true_type) noexcept
+{
+  return popcount64(x);
+}
+template <typename T>
+constexpr int
+popcount(T x, std::false_type) noexcept
+{
+  int n = 0;
+  for (; x; x >>= 64) n += popcount64((std::uint64_t)x);
+  return n;
+}
+} // namespace detail
+
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, int>::type
 countr_zero(T x) noexcept
 {
-  int i = 0;
-  for (; x; ++i) x <<= 1;
-  return std::numeric_limits<T>::digits - i;
+  if (x == 0) return std::numeric_limits<T>::digits;
+  return detail::countr_zero(x, detail::fits_word<T>());
 }
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, int>::type
 countr_one(T x) noexcept
 {
-  return countr_zero(~x);
+  return countr_zero((T)~x);
 }
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, int>::type
 countl_zero(T x) noexcept
 {
-  int i = 0;
-  for (; x; ++i) x >>= 1;
-  return std::numeric_limits<T>::digits - i;
+  if (x == 0) return std::numeric_limits<T>::digits;
+  return detail::countl_zero(x, detail::fits_word<T>());
 }
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, int>::type
 countl_one(T x) noexcept
 {
-  return countl_zero(~x);
+  return countl_zero((T)~x);
 }
 
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, int>::type
 popcount(T x) noexcept
 {
-  int i = 0;
-  for (; x; ++i) x &= x - 1;
-  return i;
-};
+  return detail::popcount(x, detail::fits_word<T>());
+}
 
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, bool>::type
 has_single_bit(T x) noexcept
 {
-  return popcount(x) == 1;
-};
+  return x && !(x & (T)(x - 1));
+}
 
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, int>::type
 bit_width(T x) noexcept
 {
-  int i = 0;
-  for (; x; ++i) x >>= 1;
-  return i;
+  return std::numeric_limits<T>::digits - countl_zero(x);
 }
 
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, T>::type
 bit_ceil(T x) noexcept
 {
-  if (x == 1) return 1;
-  return (T)1 << (bit_width(x - 1));
-};
+  if (x <= 1) return 1;
+  return (T)((T)1 << bit_width((T)(x - 1)));
+}
 
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, T>::type
 bit_floor(T x) noexcept
 {
   if (x == 0) return 0;
-  return (T)1 << (std::numeric_limits<T>::digits - countl_zero(x - 1));
-};
+  return (T)((T)1 << (bit_width(x) - 1));
+}
 
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, T>::type
 rotl(T x, int s) noexcept
 {
-  unsigned r = s;
-  r %= std::numeric_limits<T>::digits;
-  return (x << r) | (x >> (std::numeric_limits<T>::digits - r));
+  constexpr int D = std::numeric_limits<T>::digits;
+  unsigned r = (unsigned)(s % D + D) % D;
+  if (r == 0) return x;
+  return (T)((x << r) | (x >> (D - r)));
 }
 
 template <typename T>
 constexpr typename std::enable_if<std::is_unsigned<T>::value, T>::type
 rotr(T x, int s) noexcept
 {
-  unsigned r = s;
-  r %= std::numeric_limits<T>::digits;
-  return (x >> r) | (x << (std::numeric_limits<T>::digits - r));
+  constexpr int D = std::numeric_limits<T>::digits;
+  unsigned r = (unsigned)(s % D + D) % D;
+  if (r == 0) return x;
+  return (T)((x >> r) | (x << (D - r)));
 }
 
 } // namespace bitops
 } // namespace util
 #endif
+
+/* Extensions to <bit> */
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <stdlib.h>
+#endif
+
+#if defined(__has_builtin)
+#define UTIL_BITOPS_HAS_BUILTIN(x) __has_builtin(x)
+#else
+#define UTIL_BITOPS_HAS_BUILTIN(x) 0
+#endif
+
+namespace util
+{
+namespace bitops
+{
+namespace detail
+{
+template <typename T>
+using enable_word = typename std::enable_if<
+    std::is_unsigned<T>::value && std::numeric_limits<T>::digits <= 64,
+    T>::type;
+
+constexpr bool
+is_constant_evaluated() noexcept
+{
+#if __cpp_lib_is_constant_evaluated >= 201811L
+  return std::is_constant_evaluated();
+#elif defined(__GNUC__) && (__GNUC__ >= 9 || defined(__clang__))
+  return __builtin_is_constant_evaluated();
+#else
+  return true; /* always take the portable path */
+#endif
+}
+
+constexpr std::uint64_t
+byteswap64(std::uint64_t x) noexcept
+{
+#if defined(__GNUC__)
+  return __builtin_bswap64(x);
+#else
+#if defined(_MSC_VER)
+  if (!is_constant_evaluated()) return _byteswap_uint64(x);
+#endif
+  x = ((x >> 8) & 0x00ff00ff00ff00ff) | ((x & 0x00ff00ff00ff00ff) << 8);
+  x = ((x >> 16) & 0x0000ffff0000ffff) | ((x & 0x0000ffff0000ffff) << 16);
+  return (x >> 32) | (x << 32);
+#endif
+}
+
+constexpr std::uint64_t
+bit_reverse64(std::uint64_t x) noexcept
+{
+#if UTIL_BITOPS_HAS_BUILTIN(__builtin_bitreverse64)
+  return __builtin_bitreverse64(x);
+#else
+  x = ((x >> 1) & 0x5555555555555555) | ((x & 0x5555555555555555) << 1);
+  x = ((x >> 2) & 0x3333333333333333) | ((x & 0x3333333333333333) << 2);
+  x = ((x >> 4) & 0x0f0f0f0f0f0f0f0f) | ((x & 0x0f0f0f0f0f0f0f0f) << 4);
+  return byteswap64(x);
+#endif
+}
+
+constexpr std::uint64_t
+pdep64(std::uint64_t x, std::uint64_t mask) noexcept
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+  if (!is_constant_evaluated()) return _pdep_u64(x, mask);
+#endif
+  std::uint64_t r = 0;
+  for (std::uint64_t b = 1; mask; b <<= 1, mask &= mask - 1)
+    if (x & b) r |= mask & (0 - mask);
+  return r;
+}
+
+constexpr std::uint64_t
+pext64(std::uint64_t x, std::uint64_t mask) noexcept
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+  if (!is_constant_evaluated()) return _pext_u64(x, mask);
+#endif
+  std::uint64_t r = 0;
+  for (std::uint64_t b = 1; mask; b <<= 1, mask &= mask - 1)
+    if (x & mask & (0 - mask)) r |= b;
+  return r;
+}
+
+/* Bit i of x to bit 2i, and back */
+constexpr std::uint64_t
+spread2(std::uint32_t v) noexcept
+{
+  std::uint64_t x = v;
+  x = (x | (x << 16)) & 0x0000ffff0000ffff;
+  x = (x | (x << 8)) & 0x00ff00ff00ff00ff;
+  x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0f;
+  x = (x | (x << 2)) & 0x3333333333333333;
+  return (x | (x << 1)) & 0x5555555555555555;
+}
+constexpr std::uint32_t
+compact2(std::uint64_t x) noexcept
+{
+  x &= 0x5555555555555555;
+  x = (x | (x >> 1)) & 0x3333333333333333;
+  x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0f;
+  x = (x | (x >> 4)) & 0x00ff00ff00ff00ff;
+  x = (x | (x >> 8)) & 0x0000ffff0000ffff;
+  return (std::uint32_t)(x | (x >> 16));
+}
+
+/* Bit i of the low 21 bits of x to bit 3i, and back */
+constexpr std::uint64_t
+spread3(std::uint32_t v) noexcept
+{
+  std::uint64_t x = v & 0x1fffff;
+  x = (x | (x << 32)) & 0x001f00000000ffff;
+  x = (x | (x << 16)) & 0x001f0000ff0000ff;
+  x = (x | (x << 8)) & 0x100f00f00f00f00f;
+  x = (x | (x << 4)) & 0x10c30c30c30c30c3;
+  return (x | (x << 2)) & 0x1249249249249249;
+}
+constexpr std::uint32_t
+compact3(std::uint64_t x) noexcept
+{
+  x &= 0x1249249249249249;
+  x = (x | (x >> 2)) & 0x10c30c30c30c30c3;
+  x = (x | (x >> 4)) & 0x100f00f00f00f00f;
+  x = (x | (x >> 8)) & 0x001f0000ff0000ff;
+  x = (x | (x >> 16)) & 0x001f00000000ffff;
+  return (std::uint32_t)((x | (x >> 32)) & 0x1fffff);
+}
+
+constexpr std::uint64_t MORTON2_X = 0x5555555555555555;
+constexpr std::uint64_t MORTON3_X = 0x1249249249249249;
+} // namespace detail
+
+/* x with its bytes in reverse order */
+template <typename T>
+constexpr detail::enable_word<T>
+byteswap(T x) noexcept
+{
+  return (T)(detail::byteswap64(x) >> (64 - std::numeric_limits<T>::digits));
+}
+
+/* x with its bits in reverse order */
+template <typename T>
+constexpr detail::enable_word<T>
+bit_reverse(T x) noexcept
+{
+  return (T)(detail::bit_reverse64(x) >>
+             (64 - std::numeric_limits<T>::digits));
+}
+
+/* x without its lowest set bit */
+template <typename T>
+constexpr typename std::enable_if<std::is_unsigned<T>::value, T>::type
+blsr(T x) noexcept
+{
+  return x & (T)(x - 1);
+}
+
+/* Only the lowest set bit of x */
+template <typename T>
+constexpr typename std::enable_if<std::is_unsigned<T>::value, T>::type
+blsi(T x) noexcept
+{
+  return x & (T)(0 - x);
+}
+
+/* Deposits the low bits of x, in order, at the set bits of mask */
+template <typename T>
+constexpr detail::enable_word<T>
+pdep(T x, T mask) noexcept
+{
+#if defined(__BMI2__)
+  if (std::numeric_limits<T>::digits <= 32 && !detail::is_constant_evaluated())
+    return (T)_pdep_u32(x, mask);
+#endif
+  return (T)detail::pdep64(x, mask);
+}
+
+/* Gathers the bits of x at the set bits of mask into the low bits */
+template <typename T>
+constexpr detail::enable_word<T>
+pext(T x, T mask) noexcept
+{
+#if defined(__BMI2__)
+  if (std::numeric_limits<T>::digits <= 32 && !detail::is_constant_evaluated())
+    return (T)_pext_u32(x, mask);
+#endif
+  return (T)detail::pext64(x, mask);
+}
+
+/* Position of the k-th (from 0) set bit of x; k < popcount(x) */
+template <typename T>
+constexpr typename std::enable_if<std::is_unsigned<T>::value &&
+                                      std::numeric_limits<T>::digits <= 64,
+                                  int>::type
+select_in_word(T x, int k) noexcept
+{
+  std::uint64_t const w = x;
+#if defined(__BMI2__) && defined(__x86_64__)
+  if (!detail::is_constant_evaluated())
+    return countr_zero(_pdep_u64((std::uint64_t)1 << k, w));
+#endif
+  /* Broadword (Vigna): per-byte prefix counts locate the byte, then clear
+   * the set bits below the target inside it */
+  constexpr std::uint64_t L8 = 0x0101010101010101;
+  constexpr std::uint64_t H8 = 0x8080808080808080;
+  std::uint64_t s = w - ((w >> 1) & 0x5555555555555555);
+  s = (s & 0x3333333333333333) + ((s >> 2) & 0x3333333333333333);
+  s = (s + (s >> 4)) & 0x0f0f0f0f0f0f0f0f;
+  std::uint64_t const sums = s * L8; /* byte i: set bits in bytes 0..i */
+  int const place =
+      popcount((std::uint64_t)((((k * L8) | H8) - sums) & H8)) * 8;
+  int rank = k - (int)(((sums << 8) >> place) & 0xff);
+  unsigned byte = (w >> place) & 0xff;
+  for (; rank; --rank) byte &= byte - 1;
+  return place + countr_zero(byte);
+}
+
+/* Z-order code of (x, y): x in the even bits, y in the odd */
+constexpr std::uint64_t
+morton_encode(std::uint32_t x, std::uint32_t y) noexcept
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+  if (!detail::is_constant_evaluated())
+    return _pdep_u64(x, detail::MORTON2_X) |
+           _pdep_u64(y, detail::MORTON2_X << 1);
+#endif
+  return detail::spread2(x) | (detail::spread2(y) << 1);
+}
+
+/* Z-order code of the low 21 bits of x, y and z: bit i of x at 3i, of y at
+ * 3i + 1, of z at 3i + 2 */
+constexpr std::uint64_t
+morton_encode(std::uint32_t x, std::uint32_t y, std::uint32_t z) noexcept
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+  if (!detail::is_constant_evaluated())
+    return _pdep_u64(x, detail::MORTON3_X) |
+           _pdep_u64(y, detail::MORTON3_X << 1) |
+           _pdep_u64(z, detail::MORTON3_X << 2);
+#endif
+  return detail::spread3(x) | (detail::spread3(y) << 1) |
+         (detail::spread3(z) << 2);
+}
+
+/* {x, y} of a 2D Z-order code */
+constexpr std::array<std::uint32_t, 2>
+morton_decode2(std::uint64_t code) noexcept
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+  if (!detail::is_constant_evaluated())
+    return {{(std::uint32_t)_pext_u64(code, detail::MORTON2_X),
+             (std::uint32_t)_pext_u64(code, detail::MORTON2_X << 1)}};
+#endif
+  return {{detail::compact2(code), detail::compact2(code >> 1)}};
+}
+
+/* {x, y, z} of a 3D Z-order code */
+constexpr std::array<std::uint32_t, 3>
+morton_decode3(std::uint64_t code) noexcept
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+  if (!detail::is_constant_evaluated())
+    return {{(std::uint32_t)_pext_u64(code, detail::MORTON3_X),
+             (std::uint32_t)_pext_u64(code, detail::MORTON3_X << 1),
+             (std::uint32_t)_pext_u64(code, detail::MORTON3_X << 2)}};
+#endif
+  return {{detail::compact3(code), detail::compact3(code >> 1),
+           detail::compact3(code >> 2)}};
+}
+} // namespace bitops
+} // namespace util
+
+#undef UTIL_BITOPS_HAS_BUILTIN
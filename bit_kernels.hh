@@ -0,0 +1,1272 @@
+/* Bulk kernels over arrays of 64-bit chunks
+ *
+ * Used by bitmap and dynamic_bitmap for whole-bitmap operations. The
+ * implementation (scalar, SSE2, AVX2 or AVX-512 + VPOPCNTDQ) is picked once,
+ * on first use, from CPUID; every call after that is a single indirect call.
+ *
+ * The scalar kernels are the reference behavior and are the only ones used
+ * off x86, on compilers without target attributes, or when
+ * UTIL_KERNELS_SCALAR is defined.
+ *
+ * Callers are expected to handle padding bits themselves (e.g. mask the last
+ * chunk after flip).
+ *
+ * The range and shift helpers at the end work on any unsigned chunk type and
+ * in constant expressions. They mask the partial head and tail chunks and
+ * hand the whole chunks in between to the kernels above when they can. The
+ * text helpers after them do the same for binary and hex digits.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "util/bit.hh"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) &&        \
+    !defined(UTIL_KERNELS_SCALAR)
+#define UTIL_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace util
+{
+namespace kernels
+{
+using chunk_t = std::uint64_t;
+
+/* Below this many chunks the indirect call costs more than it saves */
+constexpr std::size_t MIN_CHUNKS = 8;
+
+enum class isa { scalar, sse2, avx2, avx512 };
+
+struct table {
+  isa level;
+  void (*and_assign)(chunk_t *dst, chunk_t const *src, std::size_t n);
+  void (*or_assign)(chunk_t *dst, chunk_t const *src, std::size_t n);
+  void (*xor_assign)(chunk_t *dst, chunk_t const *src, std::size_t n);
+  void (*flip)(chunk_t *dst, std::size_t n);
+  std::size_t (*count)(chunk_t const *src, std::size_t n);
+  bool (*any)(chunk_t const *src, std::size_t n);
+  bool (*all)(chunk_t const *src, std::size_t n); /* all bits set */
+  /* popcount(a op b) summed over both arrays; andnot is a & ~b */
+  std::size_t (*and_count)(chunk_t const *a, chunk_t const *b, std::size_t n);
+  std::size_t (*or_count)(chunk_t const *a, chunk_t const *b, std::size_t n);
+  std::size_t (*andnot_count)(chunk_t const *a, chunk_t const *b,
+                              std::size_t n);
+  /* a & b has any bit set; stops at the first one */
+  bool (*intersects)(chunk_t const *a, chunk_t const *b, std::size_t n);
+  /* Writes the index of every set bit of src, in order, to out and returns
+   * how many; writes nothing past them */
+  std::size_t (*decode)(chunk_t const *src, std::size_t n,
+                        std::uint32_t *out);
+  /* Index of the first chunk that is nonzero, or not all ones, or n if
+   * there is none */
+  std::size_t (*find_nonzero)(chunk_t const *src, std::size_t n);
+  std::size_t (*find_not_ones)(chunk_t const *src, std::size_t n);
+  /* Index of the last nonzero chunk, or n if there is none */
+  std::size_t (*rfind_nonzero)(chunk_t const *src, std::size_t n);
+  /* src as text, most significant bit of src[n - 1] first: 64n binary
+   * digits, or 16n hex digits. The decoders expect valid digits; binary
+   * reads anything but one as zero. */
+  void (*to_binary)(chunk_t const *src, std::size_t n, char *out, char zero,
+                    char one);
+  void (*from_binary)(char const *in, std::size_t n, chunk_t *dst, char one);
+  void (*to_hex)(chunk_t const *src, std::size_t n, char *out, bool upper);
+  void (*from_hex)(char const *in, std::size_t n, chunk_t *dst);
+};
+
+constexpr bool
+is_constant_evaluated() noexcept
+{
+#if __cpp_lib_is_constant_evaluated >= 201811L
+  return std::is_constant_evaluated();
+#elif defined(__GNUC__) && (__GNUC__ >= 9 || defined(__clang__))
+  return __builtin_is_constant_evaluated();
+#else
+  return false;
+#endif
+}
+
+namespace scalar
+{
+inline void
+and_assign(chunk_t *dst, chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i) dst[i] &= src[i];
+}
+inline void
+or_assign(chunk_t *dst, chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i) dst[i] |= src[i];
+}
+inline void
+xor_assign(chunk_t *dst, chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i) dst[i] ^= src[i];
+}
+inline void
+flip(chunk_t *dst, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i) dst[i] = ~dst[i];
+}
+inline std::size_t
+count(chunk_t const *src, std::size_t n)
+{
+  std::size_t cnt = 0;
+  for (std::size_t i = 0; i < n; ++i) cnt += bitops::popcount(src[i]);
+  return cnt;
+}
+inline bool
+any(chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    if (src[i]) return true;
+  return false;
+}
+inline bool
+all(chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    if (~src[i]) return false;
+  return true;
+}
+inline std::size_t
+and_count(chunk_t const *a, chunk_t const *b, std::size_t n)
+{
+  std::size_t cnt = 0;
+  for (std::size_t i = 0; i < n; ++i) cnt += bitops::popcount(a[i] & b[i]);
+  return cnt;
+}
+inline std::size_t
+or_count(chunk_t const *a, chunk_t const *b, std::size_t n)
+{
+  std::size_t cnt = 0;
+  for (std::size_t i = 0; i < n; ++i) cnt += bitops::popcount(a[i] | b[i]);
+  return cnt;
+}
+inline std::size_t
+andnot_count(chunk_t const *a, chunk_t const *b, std::size_t n)
+{
+  std::size_t cnt = 0;
+  for (std::size_t i = 0; i < n; ++i) cnt += bitops::popcount(a[i] & ~b[i]);
+  return cnt;
+}
+inline bool
+intersects(chunk_t const *a, chunk_t const *b, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    if (a[i] & b[i]) return true;
+  return false;
+}
+/* Clears the lowest set bit (blsr) four at a time while at least four are
+ * left, so dense words don't branch per bit */
+inline std::size_t
+decode(chunk_t const *src, std::size_t n, std::uint32_t *out)
+{
+  std::uint32_t *o = out;
+  for (std::size_t i = 0; i < n; ++i) {
+    chunk_t w = src[i];
+    std::uint32_t const base = (std::uint32_t)(i * 64);
+    std::uint32_t *const end = o + bitops::popcount(w);
+    for (; end - o >= 4; o += 4) {
+      o[0] = base + bitops::countr_zero(w);
+      w &= w - 1;
+      o[1] = base + bitops::countr_zero(w);
+      w &= w - 1;
+      o[2] = base + bitops::countr_zero(w);
+      w &= w - 1;
+      o[3] = base + bitops::countr_zero(w);
+      w &= w - 1;
+    }
+    for (; o < end; ++o, w &= w - 1) *o = base + bitops::countr_zero(w);
+  }
+  return o - out;
+}
+inline std::size_t
+find_nonzero(chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    if (src[i]) return i;
+  return n;
+}
+inline std::size_t
+find_not_ones(chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    if (~src[i]) return i;
+  return n;
+}
+inline std::size_t
+rfind_nonzero(chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = n; i-- > 0;)
+    if (src[i]) return i;
+  return n;
+}
+
+/* Text is handled eight characters at a time in one word, the first
+ * character in the low byte */
+constexpr std::uint64_t L8 = 0x0101010101010101;
+constexpr std::uint64_t H8 = 0x8080808080808080;
+
+inline std::uint64_t
+load_chars(char const *in) noexcept
+{
+  std::uint64_t v;
+  std::memcpy(&v, in, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = bitops::byteswap(v);
+#endif
+  return v;
+}
+inline void
+store_chars(char *out, std::uint64_t v) noexcept
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = bitops::byteswap(v);
+#endif
+  std::memcpy(out, &v, 8);
+}
+
+/* 0x80 in each byte of v that is zero */
+constexpr std::uint64_t
+zero_bytes(std::uint64_t v) noexcept
+{
+  return ~(((v & ~H8) + ~H8) | v) & H8;
+}
+
+/* Byte j is bit 7 - j of b (0 or 1): each byte keeps its bit of b, and the
+ * add carries it into the byte's top bit */
+constexpr std::uint64_t
+spread_byte(std::uint64_t b) noexcept
+{
+  return ((((b * L8) & 0x0102040810204080) + 0x7f7e7c7870604000) >> 7) & L8;
+}
+
+/* Byte j is nibble 7 - j of x */
+constexpr std::uint64_t
+spread_nibbles(std::uint32_t x) noexcept
+{
+  std::uint64_t v = x;
+  v = (v | (v << 16)) & 0x0000ffff0000ffff;
+  v = (v | (v << 8)) & 0x00ff00ff00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0f;
+  return bitops::byteswap(v);
+}
+
+/* The reverse of spread_nibbles, from valid hex digits */
+constexpr std::uint32_t
+gather_nibbles(std::uint64_t digits) noexcept
+{
+  std::uint64_t v = (digits & 0x0f0f0f0f0f0f0f0f) + ((digits >> 6) & L8) * 9;
+  v = bitops::byteswap(v);
+  v = (v | (v >> 4)) & 0x00ff00ff00ff00ff;
+  v = (v | (v >> 8)) & 0x0000ffff0000ffff;
+  return (std::uint32_t)(v | (v >> 16));
+}
+
+inline void
+to_binary(chunk_t const *src, std::size_t n, char *out, char zero, char one)
+{
+  std::uint64_t const z = L8 * (unsigned char)zero;
+  std::uint64_t const d = (unsigned char)(zero ^ one);
+  for (std::size_t i = n; i-- > 0;)
+    for (int k = 56; k >= 0; k -= 8, out += 8)
+      store_chars(out, z ^ spread_byte((src[i] >> k) & 0xff) * d);
+}
+inline void
+from_binary(char const *in, std::size_t n, chunk_t *dst, char one)
+{
+  std::uint64_t const o = L8 * (unsigned char)one;
+  for (std::size_t i = n; i-- > 0;) {
+    chunk_t w = 0;
+    for (int k = 0; k < 8; ++k, in += 8) {
+      std::uint64_t const ones = zero_bytes(load_chars(in) ^ o) >> 7;
+      w = (w << 8) | ((ones * 0x8040201008040201) >> 56);
+    }
+    dst[i] = w;
+  }
+}
+inline void
+to_hex(chunk_t const *src, std::size_t n, char *out, bool upper)
+{
+  std::uint64_t const letters = upper ? 'A' - '9' - 1 : 'a' - '9' - 1;
+  auto const digits = [&](std::uint32_t x) {
+    std::uint64_t const v = spread_nibbles(x);
+    return v + L8 * '0' + (((v + L8 * 6) >> 4) & L8) * letters;
+  };
+  for (std::size_t i = n; i-- > 0; out += 16) {
+    store_chars(out, digits((std::uint32_t)(src[i] >> 32)));
+    store_chars(out + 8, digits((std::uint32_t)src[i]));
+  }
+}
+inline void
+from_hex(char const *in, std::size_t n, chunk_t *dst)
+{
+  for (std::size_t i = n; i-- > 0; in += 16)
+    dst[i] = ((chunk_t)gather_nibbles(load_chars(in)) << 32) |
+             gather_nibbles(load_chars(in + 8));
+}
+} // namespace scalar
+
+#if UTIL_KERNELS_X86
+/* Vector bodies share one shape: a main loop over whole vectors followed by
+ * the scalar kernel for the tail. */
+#define UTIL_KERNELS_BINARY(name, W, load, store, op)                          \
+  UTIL_TARGET inline void name(chunk_t *dst, chunk_t const *src,               \
+                               std::size_t n)                                  \
+  {                                                                            \
+    std::size_t i = 0;                                                         \
+    for (; i + W <= n; i += W)                                                 \
+      store((void *)(dst + i), op(load((void const *)(dst + i)),               \
+                                  load((void const *)(src + i))));             \
+    scalar::name(dst + i, src + i, n - i);                                     \
+  }
+
+/* Sums popcnt(op(a, b)), where popcnt gives per-64-bit-lane counts */
+#define UTIL_KERNELS_COUNT2(name, W, vec, load, store, op, popcnt, add)        \
+  UTIL_TARGET inline std::size_t name(chunk_t const *a, chunk_t const *b,      \
+                                      std::size_t n)                           \
+  {                                                                            \
+    vec acc{};                                                                 \
+    std::size_t i = 0;                                                         \
+    for (; i + W <= n; i += W)                                                 \
+      acc = add(acc, popcnt(op(load(a + i), load(b + i))));                    \
+    chunk_t lanes[W];                                                          \
+    store(lanes, acc);                                                         \
+    std::size_t cnt = scalar::name(a + i, b + i, n - i);                       \
+    for (std::size_t l = 0; l < W; ++l) cnt += lanes[l];                       \
+    return cnt;                                                                \
+  }
+
+namespace sse2
+{
+#define UTIL_LOAD(p) _mm_loadu_si128((__m128i const *)(p))
+#define UTIL_STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define UTIL_TARGET __attribute__((target("sse2")))
+UTIL_KERNELS_BINARY(and_assign, 2, UTIL_LOAD, UTIL_STORE, _mm_and_si128)
+UTIL_KERNELS_BINARY(or_assign, 2, UTIL_LOAD, UTIL_STORE, _mm_or_si128)
+UTIL_KERNELS_BINARY(xor_assign, 2, UTIL_LOAD, UTIL_STORE, _mm_xor_si128)
+
+UTIL_TARGET inline void
+flip(chunk_t *dst, std::size_t n)
+{
+  __m128i const ones = _mm_set1_epi32(-1);
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    UTIL_STORE(dst + i, _mm_xor_si128(UTIL_LOAD(dst + i), ones));
+  scalar::flip(dst + i, n - i);
+}
+
+/* SWAR popcount within each byte, summed with psadbw */
+UTIL_TARGET inline __m128i
+popcount_epi64(__m128i v)
+{
+  __m128i const m1 = _mm_set1_epi8(0x55);
+  __m128i const m2 = _mm_set1_epi8(0x33);
+  __m128i const m4 = _mm_set1_epi8(0x0f);
+  v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+  v = _mm_add_epi8(_mm_and_si128(v, m2),
+                   _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+  v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+  return _mm_sad_epu8(v, _mm_setzero_si128());
+}
+
+UTIL_TARGET inline std::size_t
+count(chunk_t const *src, std::size_t n)
+{
+  __m128i acc = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    acc = _mm_add_epi64(acc, popcount_epi64(UTIL_LOAD(src + i)));
+  chunk_t lanes[2];
+  UTIL_STORE(lanes, acc);
+  return lanes[0] + lanes[1] + scalar::count(src + i, n - i);
+}
+
+UTIL_TARGET inline bool
+any(chunk_t const *src, std::size_t n)
+{
+  __m128i const zero = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(UTIL_LOAD(src + i), zero)) != 0xffff)
+      return true;
+  return scalar::any(src + i, n - i);
+}
+
+UTIL_TARGET inline bool
+all(chunk_t const *src, std::size_t n)
+{
+  __m128i const ones = _mm_set1_epi32(-1);
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(UTIL_LOAD(src + i), ones)) != 0xffff)
+      return false;
+  return scalar::all(src + i, n - i);
+}
+
+#define UTIL_ANDNOT(a, b) _mm_andnot_si128(b, a)
+UTIL_KERNELS_COUNT2(and_count, 2, __m128i, UTIL_LOAD, UTIL_STORE,
+                    _mm_and_si128, popcount_epi64, _mm_add_epi64)
+UTIL_KERNELS_COUNT2(or_count, 2, __m128i, UTIL_LOAD, UTIL_STORE, _mm_or_si128,
+                    popcount_epi64, _mm_add_epi64)
+UTIL_KERNELS_COUNT2(andnot_count, 2, __m128i, UTIL_LOAD, UTIL_STORE,
+                    UTIL_ANDNOT, popcount_epi64, _mm_add_epi64)
+#undef UTIL_ANDNOT
+
+UTIL_TARGET inline bool
+intersects(chunk_t const *a, chunk_t const *b, std::size_t n)
+{
+  __m128i const zero = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i v = _mm_and_si128(UTIL_LOAD(a + i), UTIL_LOAD(b + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xffff) return true;
+  }
+  return scalar::intersects(a + i, b + i, n - i);
+}
+
+/* Nothing to gain without a compress instruction */
+using scalar::decode;
+
+/* The searches compare a vector at a time, then finish inside the vector
+ * that hit with the scalar kernel */
+UTIL_TARGET inline std::size_t
+find_nonzero(chunk_t const *src, std::size_t n)
+{
+  __m128i const zero = _mm_setzero_si128();
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(UTIL_LOAD(src + i), zero)) != 0xffff)
+      break;
+  return i + scalar::find_nonzero(src + i, n - i);
+}
+
+UTIL_TARGET inline std::size_t
+find_not_ones(chunk_t const *src, std::size_t n)
+{
+  __m128i const ones = _mm_set1_epi32(-1);
+  std::size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(UTIL_LOAD(src + i), ones)) != 0xffff)
+      break;
+  return i + scalar::find_not_ones(src + i, n - i);
+}
+
+UTIL_TARGET inline std::size_t
+rfind_nonzero(chunk_t const *src, std::size_t n)
+{
+  __m128i const zero = _mm_setzero_si128();
+  std::size_t i = n;
+  for (; i >= 2; i -= 2)
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(UTIL_LOAD(src + i - 2), zero)) !=
+        0xffff)
+      break;
+  std::size_t const r = scalar::rfind_nonzero(src, i);
+  return r == i ? n : r;
+}
+
+/* Without pshufb only the binary decoder gains: pmovmskb takes 16 digits at
+ * a time, and the mask is bit-reversed into place */
+using scalar::from_hex;
+using scalar::to_binary;
+using scalar::to_hex;
+
+UTIL_TARGET inline void
+from_binary(char const *in, std::size_t n, chunk_t *dst, char one)
+{
+  __m128i const o = _mm_set1_epi8(one);
+  for (std::size_t i = n; i-- > 0; in += 64) {
+    std::uint64_t m = 0;
+    for (int k = 0; k < 4; ++k)
+      m |= (std::uint64_t)(unsigned)_mm_movemask_epi8(
+               _mm_cmpeq_epi8(UTIL_LOAD(in + 16 * k), o))
+           << (16 * k);
+    dst[i] = bitops::bit_reverse(m);
+  }
+}
+#undef UTIL_TARGET
+#undef UTIL_LOAD
+#undef UTIL_STORE
+} // namespace sse2
+
+namespace avx2
+{
+#define UTIL_LOAD(p) _mm256_loadu_si256((__m256i const *)(p))
+#define UTIL_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define UTIL_TARGET __attribute__((target("avx2,popcnt")))
+UTIL_KERNELS_BINARY(and_assign, 4, UTIL_LOAD, UTIL_STORE, _mm256_and_si256)
+UTIL_KERNELS_BINARY(or_assign, 4, UTIL_LOAD, UTIL_STORE, _mm256_or_si256)
+UTIL_KERNELS_BINARY(xor_assign, 4, UTIL_LOAD, UTIL_STORE, _mm256_xor_si256)
+
+UTIL_TARGET inline void
+flip(chunk_t *dst, std::size_t n)
+{
+  __m256i const ones = _mm256_set1_epi32(-1);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    UTIL_STORE(dst + i, _mm256_xor_si256(UTIL_LOAD(dst + i), ones));
+  scalar::flip(dst + i, n - i);
+}
+
+/* Nibble lookup popcount (Mula et al.), summed with vpsadbw */
+UTIL_TARGET inline __m256i
+popcount_epi64(__m256i v)
+{
+  __m256i const lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2,
+                                       3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2,
+                                       2, 3, 2, 3, 3, 4);
+  __m256i const low = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low));
+  __m256i hi = _mm256_shuffle_epi8(
+      lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+  return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+UTIL_TARGET inline std::size_t
+count(chunk_t const *src, std::size_t n)
+{
+  __m256i acc = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    acc = _mm256_add_epi64(acc, popcount_epi64(UTIL_LOAD(src + i)));
+  chunk_t lanes[4];
+  UTIL_STORE(lanes, acc);
+  std::size_t cnt = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  for (; i < n; ++i) cnt += __builtin_popcountll(src[i]);
+  return cnt;
+}
+
+UTIL_TARGET inline bool
+any(chunk_t const *src, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = UTIL_LOAD(src + i);
+    if (!_mm256_testz_si256(v, v)) return true;
+  }
+  return scalar::any(src + i, n - i);
+}
+
+UTIL_TARGET inline bool
+all(chunk_t const *src, std::size_t n)
+{
+  __m256i const ones = _mm256_set1_epi32(-1);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    if (!_mm256_testc_si256(UTIL_LOAD(src + i), ones)) return false;
+  return scalar::all(src + i, n - i);
+}
+
+#define UTIL_ANDNOT(a, b) _mm256_andnot_si256(b, a)
+UTIL_KERNELS_COUNT2(and_count, 4, __m256i, UTIL_LOAD, UTIL_STORE,
+                    _mm256_and_si256, popcount_epi64, _mm256_add_epi64)
+UTIL_KERNELS_COUNT2(or_count, 4, __m256i, UTIL_LOAD, UTIL_STORE,
+                    _mm256_or_si256, popcount_epi64, _mm256_add_epi64)
+UTIL_KERNELS_COUNT2(andnot_count, 4, __m256i, UTIL_LOAD, UTIL_STORE,
+                    UTIL_ANDNOT, popcount_epi64, _mm256_add_epi64)
+#undef UTIL_ANDNOT
+
+UTIL_TARGET inline bool
+intersects(chunk_t const *a, chunk_t const *b, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    if (!_mm256_testz_si256(UTIL_LOAD(a + i), UTIL_LOAD(b + i))) return true;
+  return scalar::intersects(a + i, b + i, n - i);
+}
+
+using scalar::decode;
+
+UTIL_TARGET inline std::size_t
+find_nonzero(chunk_t const *src, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i v = UTIL_LOAD(src + i);
+    if (!_mm256_testz_si256(v, v)) break;
+  }
+  return i + scalar::find_nonzero(src + i, n - i);
+}
+
+UTIL_TARGET inline std::size_t
+find_not_ones(chunk_t const *src, std::size_t n)
+{
+  __m256i const ones = _mm256_set1_epi32(-1);
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    if (!_mm256_testc_si256(UTIL_LOAD(src + i), ones)) break;
+  return i + scalar::find_not_ones(src + i, n - i);
+}
+
+UTIL_TARGET inline std::size_t
+rfind_nonzero(chunk_t const *src, std::size_t n)
+{
+  std::size_t i = n;
+  for (; i >= 4; i -= 4) {
+    __m256i v = UTIL_LOAD(src + i - 4);
+    if (!_mm256_testz_si256(v, v)) break;
+  }
+  std::size_t const r = scalar::rfind_nonzero(src, i);
+  return r == i ? n : r;
+}
+
+/* 32 digits per vector. Each output byte shuffles in the byte of the word
+ * holding its bit and tests that bit. */
+UTIL_TARGET inline void
+to_binary(chunk_t const *src, std::size_t n, char *out, char zero, char one)
+{
+  __m256i const shuf =
+      _mm256_setr_epi8(3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1,
+                       1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+  __m256i const bit = _mm256_set1_epi64x(0x0102040810204080);
+  __m256i const z = _mm256_set1_epi8(zero), o = _mm256_set1_epi8(one);
+  for (std::size_t i = n; i-- > 0;)
+    for (int h = 1; h >= 0; --h, out += 32) {
+      __m256i x = _mm256_set1_epi32((int)(src[i] >> (32 * h)));
+      x = _mm256_and_si256(_mm256_shuffle_epi8(x, shuf), bit);
+      UTIL_STORE(out, _mm256_blendv_epi8(z, o, _mm256_cmpeq_epi8(x, bit)));
+    }
+}
+
+/* Bit 31 - j is digit j of the 32 at in; reversing the digits first puts
+ * the most significant one in the top bit */
+UTIL_TARGET inline std::uint64_t
+binary_mask(char const *in, __m256i o)
+{
+  __m256i const rev =
+      _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                       15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+  __m256i v = _mm256_cmpeq_epi8(UTIL_LOAD(in), o);
+  v = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, rev), 0x4e);
+  return (unsigned)_mm256_movemask_epi8(v);
+}
+
+UTIL_TARGET inline void
+from_binary(char const *in, std::size_t n, chunk_t *dst, char one)
+{
+  __m256i const o = _mm256_set1_epi8(one);
+  for (std::size_t i = n; i-- > 0; in += 64)
+    dst[i] = (binary_mask(in, o) << 32) | binary_mask(in + 32, o);
+}
+
+/* Two words per vector: each byte, most significant first, widens to a
+ * 16-bit lane holding its two nibbles, which index a digit table */
+UTIL_TARGET inline void
+to_hex(chunk_t const *src, std::size_t n, char *out, bool upper)
+{
+  __m256i const lut =
+      upper ? _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8',
+                               '9', 'A', 'B', 'C', 'D', 'E', 'F', '0', '1',
+                               '2', '3', '4', '5', '6', '7', '8', '9', 'A',
+                               'B', 'C', 'D', 'E', 'F')
+            : _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8',
+                               '9', 'a', 'b', 'c', 'd', 'e', 'f', '0', '1',
+                               '2', '3', '4', '5', '6', '7', '8', '9', 'a',
+                               'b', 'c', 'd', 'e', 'f');
+  __m256i const low = _mm256_set1_epi16(0x0f);
+  std::size_t i = n;
+  for (; i >= 2; i -= 2, out += 32) {
+    __m256i x = _mm256_cvtepu8_epi16(
+        _mm_set_epi64x((long long)bitops::byteswap(src[i - 2]),
+                       (long long)bitops::byteswap(src[i - 1])));
+    x = _mm256_or_si256(_mm256_srli_epi16(x, 4),
+                        _mm256_slli_epi16(_mm256_and_si256(x, low), 8));
+    UTIL_STORE(out, _mm256_shuffle_epi8(lut, x));
+  }
+  scalar::to_hex(src, i, out, upper);
+}
+
+/* Digit values are (c & 0xf) + 9 for letters (bit 6 set); vpmaddubsw joins
+ * pairs into bytes, most significant first */
+UTIL_TARGET inline void
+from_hex(char const *in, std::size_t n, chunk_t *dst)
+{
+  __m256i const low = _mm256_set1_epi8(0x0f), alpha = _mm256_set1_epi8(0x40);
+  __m256i const nine = _mm256_set1_epi8(9), join = _mm256_set1_epi16(0x0110);
+  std::size_t i = n;
+  for (; i >= 2; i -= 2, in += 32) {
+    __m256i const c = UTIL_LOAD(in);
+    __m256i const letter =
+        _mm256_cmpeq_epi8(_mm256_and_si256(c, alpha), alpha);
+    __m256i v = _mm256_add_epi8(_mm256_and_si256(c, low),
+                                _mm256_and_si256(letter, nine));
+    v = _mm256_maddubs_epi16(v, join);
+    v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+    /* Stored rather than extracted: the 64-bit extracts are x86-64 only */
+    chunk_t b[2];
+    _mm_storeu_si128((__m128i *)b, _mm256_castsi256_si128(v));
+    dst[i - 1] = bitops::byteswap(b[0]);
+    dst[i - 2] = bitops::byteswap(b[1]);
+  }
+  scalar::from_hex(in, i, dst);
+}
+#undef UTIL_TARGET
+#undef UTIL_LOAD
+#undef UTIL_STORE
+} // namespace avx2
+
+namespace avx512
+{
+#define UTIL_TARGET __attribute__((target("avx512f,avx512vpopcntdq")))
+/* Tails are handled with masked loads/stores instead of a scalar loop */
+#define UTIL_KERNELS_AVX512_BINARY(name, op)                                   \
+  UTIL_TARGET inline void name(chunk_t *dst, chunk_t const *src,               \
+                               std::size_t n)                                  \
+  {                                                                            \
+    std::size_t i = 0;                                                         \
+    for (; i + 8 <= n; i += 8)                                                 \
+      _mm512_storeu_si512(dst + i, op(_mm512_loadu_si512(dst + i),            \
+                                      _mm512_loadu_si512(src + i)));           \
+    if (i < n) {                                                               \
+      __mmask8 m = (__mmask8)((1u << (n - i)) - 1);                            \
+      _mm512_mask_storeu_epi64(dst + i, m,                                     \
+                               op(_mm512_maskz_loadu_epi64(m, dst + i),        \
+                                  _mm512_maskz_loadu_epi64(m, src + i)));      \
+    }                                                                          \
+  }
+
+UTIL_KERNELS_AVX512_BINARY(and_assign, _mm512_and_si512)
+UTIL_KERNELS_AVX512_BINARY(or_assign, _mm512_or_si512)
+UTIL_KERNELS_AVX512_BINARY(xor_assign, _mm512_xor_si512)
+#undef UTIL_KERNELS_AVX512_BINARY
+
+UTIL_TARGET inline void
+flip(chunk_t *dst, std::size_t n)
+{
+  __m512i const ones = _mm512_set1_epi32(-1);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm512_storeu_si512(dst + i,
+                        _mm512_xor_si512(_mm512_loadu_si512(dst + i), ones));
+  if (i < n) {
+    __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+    __m512i v = _mm512_maskz_loadu_epi64(m, dst + i);
+    _mm512_mask_storeu_epi64(dst + i, m, _mm512_xor_si512(v, ones));
+  }
+}
+
+UTIL_TARGET inline std::size_t
+count(chunk_t const *src, std::size_t n)
+{
+  __m512i acc = _mm512_setzero_si512();
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    acc = _mm512_add_epi64(acc,
+                           _mm512_popcnt_epi64(_mm512_loadu_si512(src + i)));
+  if (i < n) {
+    __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+    acc = _mm512_add_epi64(
+        acc, _mm512_popcnt_epi64(_mm512_maskz_loadu_epi64(m, src + i)));
+  }
+  chunk_t lanes[8];
+  _mm512_storeu_si512(lanes, acc);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] +
+         lanes[6] + lanes[7];
+}
+
+UTIL_TARGET inline bool
+any(chunk_t const *src, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i v = _mm512_loadu_si512(src + i);
+    if (_mm512_test_epi64_mask(v, v)) return true;
+  }
+  return scalar::any(src + i, n - i);
+}
+
+UTIL_TARGET inline bool
+all(chunk_t const *src, std::size_t n)
+{
+  __m512i const ones = _mm512_set1_epi32(-1);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    if (_mm512_cmpneq_epi64_mask(_mm512_loadu_si512(src + i), ones))
+      return false;
+  return scalar::all(src + i, n - i);
+}
+
+#define UTIL_KERNELS_AVX512_COUNT2(name, op)                                   \
+  UTIL_TARGET inline std::size_t name(chunk_t const *a, chunk_t const *b,      \
+                                      std::size_t n)                           \
+  {                                                                            \
+    __m512i acc = _mm512_setzero_si512();                                      \
+    std::size_t i = 0;                                                         \
+    for (; i + 8 <= n; i += 8)                                                 \
+      acc = _mm512_add_epi64(                                                  \
+          acc, _mm512_popcnt_epi64(op(_mm512_loadu_si512(a + i),               \
+                                      _mm512_loadu_si512(b + i))));            \
+    if (i < n) {                                                               \
+      __mmask8 m = (__mmask8)((1u << (n - i)) - 1);                            \
+      acc = _mm512_add_epi64(                                                  \
+          acc, _mm512_popcnt_epi64(op(_mm512_maskz_loadu_epi64(m, a + i),      \
+                                      _mm512_maskz_loadu_epi64(m, b + i))));   \
+    }                                                                          \
+    chunk_t lanes[8];                                                          \
+    _mm512_storeu_si512(lanes, acc);                                           \
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] +   \
+           lanes[6] + lanes[7];                                                \
+  }
+
+/* Plain xor/and rather than _mm512_andnot_si512, whose undefined pass-through
+ * operand trips GCC's -Wuninitialized */
+#define UTIL_ANDNOT(a, b)                                                      \
+  _mm512_and_si512(a, _mm512_xor_si512(b, _mm512_set1_epi32(-1)))
+UTIL_KERNELS_AVX512_COUNT2(and_count, _mm512_and_si512)
+UTIL_KERNELS_AVX512_COUNT2(or_count, _mm512_or_si512)
+UTIL_KERNELS_AVX512_COUNT2(andnot_count, UTIL_ANDNOT)
+#undef UTIL_ANDNOT
+#undef UTIL_KERNELS_AVX512_COUNT2
+
+UTIL_TARGET inline bool
+intersects(chunk_t const *a, chunk_t const *b, std::size_t n)
+{
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    if (_mm512_test_epi64_mask(_mm512_loadu_si512(a + i),
+                               _mm512_loadu_si512(b + i)))
+      return true;
+  return scalar::intersects(a + i, b + i, n - i);
+}
+
+/* The searches take the first (or last) hit of a vector's lane mask; the
+ * tail is a masked load */
+UTIL_TARGET inline std::size_t
+find_nonzero(chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = 0; i < n; i += 8) {
+    __mmask8 const tail = n - i < 8 ? (__mmask8)((1u << (n - i)) - 1) : 0xff;
+    __m512i const v = _mm512_maskz_loadu_epi64(tail, src + i);
+    if (unsigned m = _mm512_test_epi64_mask(v, v))
+      return i + bitops::countr_zero(m);
+  }
+  return n;
+}
+
+UTIL_TARGET inline std::size_t
+find_not_ones(chunk_t const *src, std::size_t n)
+{
+  __m512i const ones = _mm512_set1_epi32(-1);
+  for (std::size_t i = 0; i < n; i += 8) {
+    __mmask8 const tail = n - i < 8 ? (__mmask8)((1u << (n - i)) - 1) : 0xff;
+    __m512i const v = _mm512_maskz_loadu_epi64(tail, src + i);
+    if (unsigned m = _mm512_mask_cmpneq_epi64_mask(tail, v, ones))
+      return i + bitops::countr_zero(m);
+  }
+  return n;
+}
+
+UTIL_TARGET inline std::size_t
+rfind_nonzero(chunk_t const *src, std::size_t n)
+{
+  for (std::size_t i = n; i > 0;) {
+    std::size_t const k = i < 8 ? i : 8;
+    i -= k;
+    __mmask8 const lanes = (__mmask8)((1u << k) - 1);
+    __m512i const v = _mm512_maskz_loadu_epi64(lanes, src + i);
+    if (unsigned m = _mm512_test_epi64_mask(v, v))
+      return i + 31 - bitops::countl_zero(m);
+  }
+  return n;
+}
+
+/* 16 bits at a time: vpcompressd packs the indices of the set bits, and a
+ * masked store writes exactly that many. Sparse words take the blsr loop.
+ * (Every AVX-512 CPU has POPCNT and BMI1.) */
+__attribute__((target("avx512f,popcnt,bmi"))) inline std::size_t
+decode(chunk_t const *src, std::size_t n, std::uint32_t *out)
+{
+  __m512i const lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                          11, 12, 13, 14, 15);
+  __m512i const step = _mm512_set1_epi32(16);
+  std::uint32_t *o = out;
+  for (std::size_t i = 0; i < n; ++i) {
+    chunk_t w = src[i];
+    std::uint32_t const base = (std::uint32_t)(i * 64);
+    int const cnt = bitops::popcount(w);
+    if (cnt <= 4) {
+      for (; w; w &= w - 1) *o++ = base + (std::uint32_t)__builtin_ctzll(w);
+      continue;
+    }
+    __m512i idx = _mm512_add_epi32(lanes, _mm512_set1_epi32((int)base));
+    for (int k = 0; k < 4; ++k, w >>= 16, idx = _mm512_add_epi32(idx, step)) {
+      __mmask16 const m = (__mmask16)w;
+      int const c = (int)_mm_popcnt_u32(m);
+      _mm512_mask_storeu_epi32(o, (__mmask16)((1u << c) - 1),
+                               _mm512_maskz_compress_epi32(m, idx));
+      o += c;
+    }
+  }
+  return o - out;
+}
+
+/* Byte-granular work needs AVX512BW, which the avx512 level doesn't
+ * require */
+using avx2::from_binary;
+using avx2::from_hex;
+using avx2::to_binary;
+using avx2::to_hex;
+#undef UTIL_TARGET
+} // namespace avx512
+#undef UTIL_KERNELS_BINARY
+#undef UTIL_KERNELS_COUNT2
+#endif
+
+#define UTIL_KERNELS_TABLE(ns)                                                 \
+  table                                                                        \
+  {                                                                            \
+    isa::ns, ns::and_assign, ns::or_assign, ns::xor_assign, ns::flip,          \
+        ns::count, ns::any, ns::all, ns::and_count, ns::or_count,              \
+        ns::andnot_count, ns::intersects, ns::decode, ns::find_nonzero,        \
+        ns::find_not_ones, ns::rfind_nonzero, ns::to_binary, ns::from_binary,  \
+        ns::to_hex, ns::from_hex                                               \
+  }
+
+inline table
+select(isa level) noexcept
+{
+  switch (level) {
+#if UTIL_KERNELS_X86
+  case isa::avx512:
+    return UTIL_KERNELS_TABLE(avx512);
+  case isa::avx2:
+    return UTIL_KERNELS_TABLE(avx2);
+  case isa::sse2:
+    return UTIL_KERNELS_TABLE(sse2);
+#endif
+  default:
+    return UTIL_KERNELS_TABLE(scalar);
+  }
+}
+#undef UTIL_KERNELS_TABLE
+
+/* Best level supported by this CPU (and OS) */
+inline isa
+detect() noexcept
+{
+#if UTIL_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512vpopcntdq"))
+    return isa::avx512;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    return isa::avx2;
+  if (__builtin_cpu_supports("sse2")) return isa::sse2;
+#endif
+  return isa::scalar;
+}
+
+inline table const &
+active() noexcept
+{
+  static table const t = select(detect());
+  return t;
+}
+
+namespace range
+{
+template <class ChunkT>
+constexpr std::size_t chunk_bits = std::numeric_limits<ChunkT>::digits;
+
+/* Bits [lo, hi) of a chunk, 0 <= lo < hi <= chunk_bits */
+template <class ChunkT>
+constexpr ChunkT
+mask(std::size_t lo, std::size_t hi) noexcept
+{
+  ChunkT const ones = (ChunkT)~(ChunkT)0;
+  return (ChunkT)((ChunkT)(ones << lo) &
+                  (ChunkT)(ones >> (chunk_bits<ChunkT> - hi)));
+}
+
+/* Calls edge(i, mask) for the partial chunks and whole(i, n) for the run of
+ * n whole chunks starting at i covering bits [first, last) */
+template <class ChunkT, class Edge, class Whole>
+constexpr void
+for_range(std::size_t first, std::size_t last, Edge edge, Whole whole)
+{
+  constexpr std::size_t B = chunk_bits<ChunkT>;
+  if (first >= last) return;
+  std::size_t const fc = first / B, lc = (last - 1) / B;
+  if (fc == lc) {
+    edge(fc, mask<ChunkT>(first % B, (last - 1) % B + 1));
+    return;
+  }
+  std::size_t begin = fc, end = lc + 1;
+  if (first % B) edge(begin++, mask<ChunkT>(first % B, B));
+  if (last % B) edge(--end, mask<ChunkT>(0, last % B));
+  if (begin < end) whole(begin, end - begin);
+}
+
+template <class ChunkT>
+constexpr void
+fill(ChunkT *p, std::size_t first, std::size_t last, bool val) noexcept
+{
+  for_range<ChunkT>(
+      first, last,
+      [&](std::size_t i, ChunkT m) {
+        p[i] = val ? (ChunkT)(p[i] | m) : (ChunkT)(p[i] & ~m);
+      },
+      [&](std::size_t i, std::size_t n) {
+        for (std::size_t j = i; j < i + n; ++j) p[j] = val ? ~(ChunkT)0 : 0;
+      });
+}
+
+template <class ChunkT>
+constexpr void
+flip(ChunkT *p, std::size_t first, std::size_t last) noexcept
+{
+  for_range<ChunkT>(
+      first, last, [&](std::size_t i, ChunkT m) { p[i] ^= m; },
+      [&](std::size_t i, std::size_t n) {
+        if constexpr (std::is_same<ChunkT, chunk_t>::value)
+          if (!is_constant_evaluated() && n >= MIN_CHUNKS)
+            return active().flip(p + i, n);
+        for (std::size_t j = i; j < i + n; ++j) p[j] = ~p[j];
+      });
+}
+
+template <class ChunkT>
+constexpr std::size_t
+count(ChunkT const *p, std::size_t first, std::size_t last) noexcept
+{
+  std::size_t cnt = 0;
+  for_range<ChunkT>(
+      first, last,
+      [&](std::size_t i, ChunkT m) {
+        cnt += bitops::popcount((ChunkT)(p[i] & m));
+      },
+      [&](std::size_t i, std::size_t n) {
+        if constexpr (std::is_same<ChunkT, chunk_t>::value)
+          if (!is_constant_evaluated() && n >= MIN_CHUNKS) {
+            cnt += active().count(p + i, n);
+            return;
+          }
+        for (std::size_t j = i; j < i + n; ++j) cnt += bitops::popcount(p[j]);
+      });
+  return cnt;
+}
+
+/* Moves bit i of p[0..n) to bit i + shift (toward the last chunk), filling
+ * with zeros. Bits pushed past the last chunk are lost; padding bits in the
+ * last chunk are not cleared. */
+template <class ChunkT>
+constexpr void
+shift_up(ChunkT *p, std::size_t n, std::size_t shift) noexcept
+{
+  constexpr std::size_t B = chunk_bits<ChunkT>;
+  std::size_t const w = shift / B, b = shift % B;
+  if (w >= n) {
+    for (std::size_t i = 0; i < n; ++i) p[i] = 0;
+    return;
+  }
+  for (std::size_t i = n - 1; i > w; --i)
+    p[i] = (ChunkT)(p[i - w] << b) |
+           (b ? (ChunkT)(p[i - w - 1] >> (B - b)) : (ChunkT)0);
+  p[w] = (ChunkT)(p[0] << b);
+  for (std::size_t i = 0; i < w; ++i) p[i] = 0;
+}
+
+/* Moves bit i of p[0..n) to bit i - shift, filling with zeros. Expects the
+ * padding bits of the last chunk to be clear. */
+template <class ChunkT>
+constexpr void
+shift_down(ChunkT *p, std::size_t n, std::size_t shift) noexcept
+{
+  constexpr std::size_t B = chunk_bits<ChunkT>;
+  std::size_t const w = shift / B, b = shift % B;
+  if (w >= n) {
+    for (std::size_t i = 0; i < n; ++i) p[i] = 0;
+    return;
+  }
+  for (std::size_t i = 0; i + w + 1 < n; ++i)
+    p[i] = (ChunkT)(p[i + w] >> b) |
+           (b ? (ChunkT)(p[i + w + 1] << (B - b)) : (ChunkT)0);
+  p[n - w - 1] = (ChunkT)(p[n - 1] >> b);
+  for (std::size_t i = n - w; i < n; ++i) p[i] = 0;
+}
+} // namespace range
+
+/* Binary and hex text for bits [0, bits) of any chunk array, most
+ * significant digit first: bits binary digits, or (bits + 3) / 4 hex. Whole
+ * words go to the kernels; the partial word at the top goes through a
+ * 64-character buffer. */
+namespace text
+{
+/* Word k of p[0..n), for chunks of up to 64 bits */
+template <class ChunkT>
+constexpr std::uint64_t
+word(ChunkT const *p, std::size_t n, std::size_t k) noexcept
+{
+  constexpr std::size_t B = range::chunk_bits<ChunkT>, PER = 64 / B;
+  std::uint64_t w = 0;
+  for (std::size_t j = 0; j < PER && k * PER + j < n; ++j)
+    w |= (std::uint64_t)p[k * PER + j] << (j * B % 64);
+  return w;
+}
+template <class ChunkT>
+constexpr void
+set_word(ChunkT *p, std::size_t n, std::size_t k, std::uint64_t w) noexcept
+{
+  constexpr std::size_t B = range::chunk_bits<ChunkT>, PER = 64 / B;
+  for (std::size_t j = 0; j < PER && k * PER + j < n; ++j)
+    p[k * PER + j] = (ChunkT)(w >> (j * B % 64));
+}
+
+template <class ChunkT>
+void
+to_binary(ChunkT const *p, std::size_t n, std::size_t bits, char *out,
+          char zero, char one)
+{
+  if (!bits) return;
+  std::size_t const words = (bits + 63) / 64, top = bits - 64 * (words - 1);
+  char buf[64];
+  chunk_t w = word(p, n, words - 1);
+  scalar::to_binary(&w, 1, buf, zero, one);
+  std::memcpy(out, buf + 64 - top, top);
+  out += top;
+  if constexpr (std::is_same<ChunkT, chunk_t>::value)
+    return (words - 1 >= MIN_CHUNKS ? active().to_binary : scalar::to_binary)(
+        p, words - 1, out, zero, one);
+  for (std::size_t k = words - 1; k-- > 0; out += 64) {
+    w = word(p, n, k);
+    scalar::to_binary(&w, 1, out, zero, one);
+  }
+}
+
+/* Sets all of p[0..n) from bits valid digits; bits <= 64n */
+template <class ChunkT>
+void
+from_binary(char const *in, std::size_t bits, ChunkT *p, std::size_t n,
+            char zero, char one)
+{
+  constexpr std::size_t PER = 64 / range::chunk_bits<ChunkT>;
+  std::size_t const words = (bits + 63) / 64;
+  for (std::size_t i = words * PER; i < n; ++i) p[i] = 0;
+  if (!bits) return;
+  std::size_t const top = bits - 64 * (words - 1);
+  char buf[64];
+  std::memset(buf, zero, 64 - top);
+  std::memcpy(buf + 64 - top, in, top);
+  chunk_t w;
+  scalar::from_binary(buf, 1, &w, one);
+  set_word(p, n, words - 1, w);
+  in += top;
+  if constexpr (std::is_same<ChunkT, chunk_t>::value)
+    return (words - 1 >= MIN_CHUNKS ? active().from_binary
+                                    : scalar::from_binary)(in, words - 1, p,
+                                                           one);
+  for (std::size_t k = words - 1; k-- > 0; in += 64) {
+    scalar::from_binary(in, 1, &w, one);
+    set_word(p, n, k, w);
+  }
+}
+
+template <class ChunkT>
+void
+to_hex(ChunkT const *p, std::size_t n, std::size_t bits, char *out,
+       bool upper)
+{
+  if (!bits) return;
+  std::size_t const digits = (bits + 3) / 4;
+  std::size_t const words = (digits + 15) / 16;
+  std::size_t const top = digits - 16 * (words - 1);
+  char buf[16];
+  chunk_t w = word(p, n, words - 1);
+  scalar::to_hex(&w, 1, buf, upper);
+  std::memcpy(out, buf + 16 - top, top);
+  out += top;
+  if constexpr (std::is_same<ChunkT, chunk_t>::value)
+    return (words - 1 >= MIN_CHUNKS ? active().to_hex : scalar::to_hex)(
+        p, words - 1, out, upper);
+  for (std::size_t k = words - 1; k-- > 0; out += 16) {
+    w = word(p, n, k);
+    scalar::to_hex(&w, 1, out, upper);
+  }
+}
+
+/* Sets all of p[0..n) from digits valid hex digits; 4 * digits <= 64n */
+template <class ChunkT>
+void
+from_hex(char const *in, std::size_t digits, ChunkT *p, std::size_t n)
+{
+  constexpr std::size_t PER = 64 / range::chunk_bits<ChunkT>;
+  std::size_t const words = (digits + 15) / 16;
+  for (std::size_t i = words * PER; i < n; ++i) p[i] = 0;
+  if (!digits) return;
+  std::size_t const top = digits - 16 * (words - 1);
+  char buf[16];
+  std::memset(buf, '0', 16 - top);
+  std::memcpy(buf + 16 - top, in, top);
+  chunk_t w;
+  scalar::from_hex(buf, 1, &w);
+  set_word(p, n, words - 1, w);
+  in += top;
+  if constexpr (std::is_same<ChunkT, chunk_t>::value)
+    return (words - 1 >= MIN_CHUNKS ? active().from_hex : scalar::from_hex)(
+        in, words - 1, p);
+  for (std::size_t k = words - 1; k-- > 0; in += 16) {
+    scalar::from_hex(in, 1, &w);
+    set_word(p, n, k, w);
+  }
+}
+
+/* Value of a valid hex digit */
+constexpr unsigned
+hex_value(char c) noexcept
+{
+  return (c & 0xf) + ((c >> 6) & 1) * 9;
+}
+
+/* Length of the run of digits at first, eight characters a step */
+inline std::size_t
+binary_span(char const *first, char const *last, char zero, char one)
+{
+  using scalar::H8;
+  using scalar::L8;
+  std::uint64_t const z = L8 * (unsigned char)zero;
+  std::uint64_t const o = L8 * (unsigned char)one;
+  char const *p = first;
+  for (; last - p >= 8; p += 8) {
+    std::uint64_t const v = scalar::load_chars(p);
+    std::uint64_t const bad =
+        ~(scalar::zero_bytes(v ^ z) | scalar::zero_bytes(v ^ o)) & H8;
+    if (bad) return (p - first) + bitops::countr_zero(bad) / 8;
+  }
+  while (p != last && (*p == zero || *p == one)) ++p;
+  return p - first;
+}
+
+inline std::size_t
+hex_span(char const *first, char const *last)
+{
+  using scalar::H8;
+  using scalar::L8;
+  /* 0x80 in each byte of v (all below 0x80) within [lo, hi] */
+  auto const within = [](std::uint64_t v, unsigned lo, unsigned hi) {
+    return (v + L8 * (0x80 - lo)) & ~(v + L8 * (0x7f - hi)) & H8;
+  };
+  char const *p = first;
+  for (; last - p >= 8; p += 8) {
+    std::uint64_t const v = scalar::load_chars(p);
+    std::uint64_t const a = v & ~H8;
+    std::uint64_t const ok = (within(a, '0', '9') |
+                              within(a | (L8 * 0x20), 'a', 'f')) &
+                             ~v;
+    if (std::uint64_t const bad = ~ok & H8)
+      return (p - first) + bitops::countr_zero(bad) / 8;
+  }
+  auto const xdigit = [](char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+  };
+  while (p != last && xdigit(*p)) ++p;
+  return p - first;
+}
+} // namespace text
+
+} // namespace kernels
+} // namespace util
@@ -3,406 +3,376 @@
  * Supports fast iteration vs std::vector<bool> and std::bitset while also
  * supporting the bitwise arithmetic of std::bitset
  *
- * Benchmark results:
- * + Several orders of magnitude faster than std::vector<bool> for just about
- * anything.
- * + On-par with std::bitset for most operations; orders of magnitude faster
- * iteration over set bits.
- * + Dynamic_bitmap is ~20x slower for small sizes, but reaches parity around
- * ~256-512 bits.
+ * bitmap<N> has its size fixed at compile time; bitmap<0> (a.k.a.
+ * dynamic_bitmap) takes it at runtime and keeps up to 256 bits inline before
+ * spilling to memory from its Allocator; bitmap_view works on chunks owned
+ * elsewhere. All three share the algorithms in basic_bitmap.
+ *
+ * Allocator only matters for bitmap<0>. It may be any allocator of
+ * std::uint64_t, including std::pmr::polymorphic_allocator (see
+ * pmr::dynamic_bitmap) and the arena and pool allocators in
+ * bitmap_resource.hh.
+ *
+ * Benchmark results (bench/bitmap_bench as configured: C++17, Release,
+ * GCC 12, AVX-512 Xeon; ns per operation, bitmap<N> vs std::bitset):
+ * + count() is 1.5-2x faster up to 256 bits, ~4x at 512 and 12-24x from 4096
+ * (4096: 12 vs 204; 1M: 2.1us vs 27us).
+ * + &= is on par up to 4096 bits (4096: 19 vs 22) and 1.3-2.4x faster past
+ * that (64K: 132 vs 320; 1M: 3.2-3.8us vs 3.6-5.6us, memory bound).
+ * + Both are two to three orders of magnitude faster than std::vector<bool>.
+ * + Iteration costs 2-4ns per set bit up to 64K bits (10ns at 1M, 1%
+ * dense). A test() loop over a 1%-dense std::bitset costs 80-170ns per set
+ * bit; libstdc++'s _Find_next costs 3-12ns, about 2x slower at 50% dense
+ * and on par at 1%.
+ * + Copies match std::bitset. Dynamic_bitmap keeps up to 256 bits inline, so
+ * small ones copy in ~3-5ns without allocating (bitmap: <1ns); past that a
+ * copy pays for a heap allocation.
  *
  * Author: Ryan Gambord <Ryan.Gambord@oregonstate.edu>
  * Date: July 26 2023
  */
 #pragma once
-#include <algorithm>
-#include <array>
 #include <bitset>
+#include <cctype>
+#include <climits>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <memory_resource>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
 #include <type_traits>
-#include <vector>
 
-#include "util/adaptors/reverse.hh"
-#include "util/bit.hh"
-#include "util/fitted_int.hh"
+#include "util/basic_bitmap.hh"
+#include "util/bitmap_expr.hh"
+#include "util/bitmap_storage.hh"
 
 namespace util
 {
+namespace detail
+{
+/* clang-format off */
+template <std::size_t N>
+using bitmap_chunk_t = typename std::conditional<N <= 8,  std::uint_fast8_t,
+                       typename std::conditional<N <= 16, std::uint_fast16_t,
+                       typename std::conditional<N <= 32, std::uint_fast32_t,
+                                                          std::uint_fast64_t
+                       >::type>::type>::type;
+/* clang-format on */
 
 template <std::size_t N>
-class bitmap
-{
-public:
-  using id_type = fitted_int::uint_fastX_t<N>;
+using fixed_storage_t = bitmap_storage::fixed<bitmap_chunk_t<N>, N>;
+
+/* libstdc++, libc++ and the MSVC STL all lay std::bitset out as an array of
+ * words with bit i at bit i % W of word i / W and the padding bits clear.
+ * On a little-endian machine that puts bit i at bit i % 8 of byte i / 8
+ * whatever W is, which is also where the chunks keep it, so conversions
+ * are a byte copy. Elsewhere they go through the bit string. */
+#if (defined(__GLIBCXX__) || defined(_LIBCPP_VERSION) ||                     \
+     defined(_MSVC_STL_VERSION)) &&                                            \
+    (defined(_MSC_VER) || (defined(__BYTE_ORDER__) &&                         \
+                           __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__))
+constexpr bool BITSET_BYTE_LAYOUT = true;
+#else
+constexpr bool BITSET_BYTE_LAYOUT = false;
+#endif
 
-private:
-  /* clang-format off */
-  using ChunkT = typename std::conditional<N <= 8,  std::uint_fast8_t,
-                 typename std::conditional<N <= 16, std::uint_fast16_t,
-                 typename std::conditional<N <= 32, std::uint_fast32_t,
-                                                    std::uint_fast64_t
-                 >::type>::type>::type;
-  /* clang-format on */
-  constexpr static auto CHUNK_BITS = std::numeric_limits<ChunkT>::digits;
-  constexpr static auto CHUNK_COUNT = (N + CHUNK_BITS - 1) / CHUNK_BITS;
-  constexpr static auto PAD_BITS = (CHUNK_BITS * CHUNK_COUNT) - N;
-  constexpr static auto PAD_MASK = (ChunkT)((~(ChunkT)0) >> PAD_BITS);
-
-  std::array<ChunkT, CHUNK_COUNT> _bit_array;
-
-  class BitId;
-
-  class ChunkId
-  {
-  private:
-    using T = fitted_int::uint_fastX_t<CHUNK_COUNT>;
-    T _val;
-
-  public:
-    explicit constexpr ChunkId(T val) : _val(val) {}
-    constexpr ChunkId(BitId id) : _val(id / CHUNK_BITS){};
-    constexpr operator T &() { return _val; }
-    constexpr operator T const &() const { return _val; }
-  };
-
-  class ChunkOffset
-  {
-  private:
-    using T = fitted_int::uint_fastX_t<CHUNK_BITS>;
-    T _val;
-
-  public:
-    constexpr ChunkOffset(T val) : _val(val) {}
-    constexpr ChunkOffset(BitId id) : _val(id % CHUNK_BITS) {}
-    constexpr operator T &() { return _val; }
-    constexpr operator T const &() const { return _val; }
-  };
-
-  class BitId
-  {
-  private:
-    using T = id_type;
-    T _val;
-
-  public:
-    constexpr BitId(T val = 0) : _val(val) {}
-    constexpr BitId(ChunkId id, ChunkOffset offset)
-        : _val(id * CHUNK_BITS + offset)
-    {
+template <std::size_t N>
+constexpr bool bitset_bytes =
+    BITSET_BYTE_LAYOUT && N != 0 &&
+    std::is_trivially_copyable<std::bitset<N>>::value &&
+    sizeof(std::bitset<N>) * CHAR_BIT >= N;
+
+/* Sets all of p[0..n), which holds at least N bits, from b */
+template <std::size_t N, class ChunkT>
+constexpr void
+bitset_to_chunks(std::bitset<N> const &b, ChunkT *p, std::size_t n)
+{
+  if (!kernels::is_constant_evaluated()) {
+    if constexpr (bitset_bytes<N>) {
+      std::memset((void *)p, 0, n * sizeof(ChunkT));
+      std::memcpy((void *)p, (void const *)&b, (N + 7) / 8);
+    } else {
+      std::string const s = b.to_string();
+      kernels::text::from_binary(s.data(), N, p, n, '0', '1');
     }
-    constexpr operator T &() { return _val; }
-    constexpr operator T const &() const { return _val; }
-  };
-
-public:
-  constexpr bitmap() : _bit_array{} {}
+    return;
+  }
+  constexpr std::size_t B = std::numeric_limits<ChunkT>::digits;
+  for (std::size_t i = 0; i < n; ++i) p[i] = 0;
+  for (std::size_t i = 0; i < N; ++i)
+    if (b[i]) p[i / B] |= (ChunkT)((ChunkT)1 << (i % B));
+}
 
-  explicit constexpr bitmap(std::bitset<N> const &other) : _bit_array{}
-  {
-    static_assert(std::numeric_limits<unsigned long long>::digits >=
-                  CHUNK_BITS);
-    std::bitset<N> mask;
-    mask.flip() >>= (N - CHUNK_BITS);
-    std::bitset<N> copy(other);
-    for (ChunkT &chunk : _bit_array) {
-      chunk = (copy & mask).to_ullong();
-      copy >>= CHUNK_BITS;
+/* The first N bits of p[0..n) */
+template <std::size_t N, class ChunkT>
+constexpr std::bitset<N>
+chunks_to_bitset(ChunkT const *p, std::size_t n)
+{
+  constexpr std::size_t B = std::numeric_limits<ChunkT>::digits;
+  std::bitset<N> ret;
+  if constexpr (bitset_bytes<N>) {
+    if (!kernels::is_constant_evaluated()) {
+      std::memcpy((void *)&ret, (void const *)p, (N + 7) / 8);
+      return ret;
     }
   }
+  for (std::size_t i = 0; i < n; ++i)
+    for (ChunkT c = p[i]; c; c &= c - 1)
+      ret[i * B + bitops::countr_zero(c)] = true;
+  return ret;
+}
 
-  explicit constexpr operator std::bitset<N>() const
-  {
-    static_assert(std::numeric_limits<unsigned long long>::digits >=
-                  CHUNK_BITS);
-    std::bitset<N> ret;
+/* Assigns all of str, in base 2 or 16, to x or throws */
+template <class Bitmap>
+void
+assign_digits(Bitmap &x, std::string_view str, int base)
+{
+  if (str.empty()) return;
+  auto const r = x.from_chars(str.data(), str.data() + str.size(), base);
+  if (r.ec == std::errc::result_out_of_range)
+    throw std::out_of_range("bitmap: value too wide");
+  if (r.ec != std::errc() || r.ptr != str.data() + str.size())
+    throw std::invalid_argument("bitmap: bad digit");
+}
+} // namespace detail
 
-    for (ChunkT const &chunk : adaptor::reverse(_bit_array)) {
-      ret <<= CHUNK_BITS;
-      ret |= chunk;
-    }
-    return ret;
-  }
+template <std::size_t N, class Allocator = std::allocator<std::uint64_t>>
+class bitmap
+    : public basic_bitmap<bitmap<N, Allocator>, detail::fixed_storage_t<N>>
+{
+private:
+  using base = basic_bitmap<bitmap<N, Allocator>, detail::fixed_storage_t<N>>;
+  using ChunkT = typename base::chunk_type;
 
 public:
-  constexpr std::size_t size() const { return N; }
+  constexpr bitmap() = default;
 
-  constexpr bitmap &set(BitId bit, bool val = true)
+  template <class E, class = bitmap_expr::enable_for<E, bitmap>>
+  constexpr bitmap(E const &expr)
   {
-    if (bit >= N) throw std::range_error("invalid index");
-    (*this)[bit] = val;
-    return *this;
+    this->assign_expr(expr, [](ChunkT, ChunkT rhs) { return rhs; });
   }
 
-  constexpr bitmap &set() noexcept
+  template <class E, class = bitmap_expr::enable_for<E, bitmap>>
+  constexpr bitmap &operator=(E const &expr) noexcept
   {
-    for (auto &chunk : _bit_array) chunk = ~(ChunkT)0;
-    _bit_array.back() &= PAD_MASK;
-    return *this;
+    return this->assign_expr(expr, [](ChunkT, ChunkT rhs) { return rhs; });
   }
 
-  constexpr bitmap &reset() noexcept
+  /* Digits in base 2 or 16, most significant first; throws
+   * std::invalid_argument on any other character and std::out_of_range if
+   * the value needs more than N bits */
+  explicit bitmap(std::string_view str, int base = 2)
   {
-    for (auto &chunk : _bit_array) chunk = 0;
-    return *this;
-  }
-  constexpr bitmap &reset(BitId bit)
-  {
-    set(bit, false);
-    return *this;
+    detail::assign_digits(*this, str, base);
   }
 
-  constexpr bitmap &flip(BitId bit)
+  explicit constexpr bitmap(std::bitset<N> const &other)
   {
-    set(bit, ~(*this)[bit]);
-    return *this;
+    detail::bitset_to_chunks(other, this->_storage.data(),
+                             this->_storage.chunk_count());
   }
 
-  constexpr bitmap &flip() noexcept
-  {
-    for (auto &chunk : _bit_array) chunk = ~chunk;
-    _bit_array.back() &= PAD_MASK;
-    return *this;
-  }
-
-  constexpr bool test(BitId bit) const
+  explicit constexpr operator std::bitset<N>() const
   {
-    if (bit >= N) throw std::range_error("invalid index");
-    return (*this)[bit];
+    return detail::chunks_to_bitset<N>(this->_storage.data(),
+                                       this->_storage.chunk_count());
   }
+};
 
-  constexpr bool operator==(bitmap const &other) const noexcept
-  {
-    return std::equal(_bit_array.cbegin(), _bit_array.cend(),
-                      other._bit_array.cbegin());
-  }
+/* Runtime-sized bitmap, a.k.a. dynamic_bitmap */
+template <class Allocator>
+class bitmap<0, Allocator>
+    : public basic_bitmap<bitmap<0, Allocator>,
+                          bitmap_storage::small<std::uint64_t, 4, Allocator>>
+{
+private:
+  using storage = bitmap_storage::small<std::uint64_t, 4, Allocator>;
+  using base = basic_bitmap<bitmap<0, Allocator>, storage>;
+  using ChunkT = typename base::chunk_type;
 
-  constexpr bool operator!=(bitmap const &other) const noexcept
-  {
-    return !(*this == other);
-  }
+  using base::_storage;
+  using base::assign_expr;
+  using base::mask_tail;
 
-  constexpr bitmap operator~() const noexcept { return bitmap(*this).flip(); }
+public:
+  using allocator_type = Allocator;
 
-  constexpr bitmap &operator&=(bitmap const &other) noexcept
+  bitmap(std::size_t size, Allocator const &alloc = Allocator())
+      : base(storage(size, alloc))
   {
-    std::transform(_bit_array.begin(), _bit_array.end(),
-                   other._bit_array.begin(), _bit_array.begin(),
-                   std::bit_and());
-    return *this;
   }
-  constexpr bitmap &operator|=(bitmap const &other) noexcept
+
+  template <class E, class = bitmap_expr::enable_for<E, bitmap>>
+  bitmap(E const &expr, Allocator const &alloc = Allocator())
+      : bitmap(expr.size(), alloc)
   {
-    std::transform(_bit_array.begin(), _bit_array.end(),
-                   other._bit_array.begin(), _bit_array.begin(), std::bit_or());
-    return *this;
+    assign_expr(expr, [](ChunkT, ChunkT rhs) { return rhs; });
   }
-  constexpr bitmap &operator^=(bitmap const &other) noexcept
+
+  template <class E, class = bitmap_expr::enable_for<E, bitmap>>
+  bitmap &operator=(E const &expr)
   {
-    std::transform(_bit_array.begin(), _bit_array.end(),
-                   other._bit_array.begin(), _bit_array.begin(),
-                   std::bit_xor());
-    return *this;
+    resize(expr.size());
+    return assign_expr(expr, [](ChunkT, ChunkT rhs) { return rhs; });
   }
 
-  constexpr bool any() const noexcept
+  /* Sized to the digits: str.size() bits in base 2, four per digit in base
+   * 16. Throws std::invalid_argument on a character that isn't one. */
+  explicit bitmap(std::string_view str, int base = 2,
+                  Allocator const &alloc = Allocator())
+      : bitmap(base == 16 ? 4 * str.size() : str.size(), alloc)
   {
-    for (auto const v : _bit_array)
-      if (v) return true;
-    return false;
+    detail::assign_digits(*this, str, base);
   }
-  constexpr bool none() const noexcept { return !any(); }
-  constexpr bool all() const noexcept
+
+  template <std::size_t N>
+  explicit bitmap(std::bitset<N> const &other,
+                  Allocator const &alloc = Allocator())
+      : bitmap(N, alloc)
   {
-    return _bit_array.back() == PAD_MASK &&
-           std::all_of(_bit_array.begin(), _bit_array.end() - 1,
-                       [](auto x) { return !~x; });
+    detail::bitset_to_chunks(other, _storage.data(), _storage.chunk_count());
   }
 
-  constexpr BitId count() const noexcept
+  /* New bits are clear */
+  void resize(std::size_t size)
   {
-    BitId cnt = 0;
-    for (auto const &v : _bit_array) cnt += bitops::popcount(v);
-    return cnt;
+    _storage.resize(size);
+    mask_tail();
   }
 
-  class bit_proxy
-  {
-    friend bitmap;
+  allocator_type get_allocator() const { return _storage.get_allocator(); }
+};
 
-  private:
-    ChunkT &_chunk;
-    ChunkT _mask;
-    constexpr bit_proxy(ChunkT &chunk, ChunkT mask) : _chunk(chunk), _mask(mask)
-    {
-    }
-    constexpr bit_proxy(ChunkT &chunk, ChunkOffset offset)
-        : _chunk(chunk), _mask(ChunkT(1) << offset)
-    {
-    }
+using dynamic_bitmap = bitmap<0>;
 
-  public:
-    constexpr operator bool() const noexcept { return _chunk & _mask; }
-    constexpr bit_proxy &operator=(bool val) noexcept
-    {
-      if (val) _chunk |= _mask;
-      else _chunk &= ~_mask;
-      return *this;
-    }
-    constexpr bool operator~() const noexcept { return !*this; }
-    constexpr bit_proxy &flip() noexcept { return *this = ~*this; }
-  };
+namespace pmr
+{
+using dynamic_bitmap =
+    bitmap<0, std::pmr::polymorphic_allocator<std::uint64_t>>;
+} // namespace pmr
+
+/* A bitmap over chunks owned elsewhere, e.g. a memory-mapped file. ChunkT
+ * may be const, in which case only the non-mutating operations compile. */
+template <class ChunkT = std::uint64_t>
+class bitmap_view
+    : public basic_bitmap<bitmap_view<ChunkT>, bitmap_storage::view<ChunkT>>
+{
+private:
+  using storage = bitmap_storage::view<ChunkT>;
+  using base = basic_bitmap<bitmap_view<ChunkT>, storage>;
 
 public:
-  constexpr bit_proxy operator[](BitId id)
-  {
-    return bit_proxy(_bit_array[ChunkId(id)], ChunkOffset(id));
-  }
-  constexpr bool operator[](BitId id) const
+  /* chunks must hold size bits, with the padding bits of the last chunk
+   * clear, and outlive the view */
+  constexpr bitmap_view(ChunkT *chunks, std::size_t size)
+      : base(storage(chunks, size))
   {
-    ChunkT mask = ChunkT(1) << ChunkOffset(id);
-    return (bool)(ChunkT)(_bit_array[ChunkId(id)] & mask);
   }
+};
 
-  class biterator
-  {
-    friend bitmap;
-
-  public:
-    using difference_type = BitId;
-    using value_type = BitId;
-    using pointer = value_type *;
-    using reference = value_type;
-    using iterator_category = std::bidirectional_iterator_tag;
-
-  private:
-    bitmap &_ref;
-    ChunkId _id;
-    ChunkOffset _offset;
-    constexpr biterator(bitmap &ref, ChunkId id, ChunkOffset offset)
-        : _ref(ref), _id(id), _offset(offset)
-    {
-    }
-    constexpr biterator(bitmap &ref, BitId id) : _ref(ref), _id(id), _offset(id)
-    {
-    }
-
-  public:
-    constexpr reference operator*() { return reference(_id, _offset); }
-
-    biterator &operator++()
-    {
-      if (_id >= CHUNK_COUNT) throw std::range_error("iterate past end");
-      ChunkT chunk = _ref._bit_array[_id] >> (_offset + 1);
-      if ((_offset + 1 < CHUNK_BITS) && chunk) {
-        _offset += bitops::countr_zero(chunk) + 1;
-      } else {
-        _offset = 0; /* IMPORTANT */
-        while (++_id < CHUNK_COUNT) {
-          chunk = _ref._bit_array[_id];
-          if (chunk) {
-            _offset = bitops::countr_zero(chunk);
-            break;
-          }
-        }
-      }
-      return *this;
-    }
-    biterator operator++(int) { return ++biterator(*this); }
-
-    biterator &operator--()
-    {
-      ChunkT chunk = _ref._bit_array[_id] << (CHUNK_BITS - _offset);
-      if (_offset && chunk) {
-        _offset -= bitops::countl_zero(chunk);
-      } else {
-        _offset = 0; /* IMPORTANT */
-        while (_id-- > 0) {
-          chunk = _ref._bit_array[_id];
-          if (chunk) {
-            _offset = bitops::countl_zero(chunk);
-            break;
-          }
-          throw std::range_error("iterate before begin");
-        }
-      }
-      return *this;
-    }
-    biterator operator--(int) { return --biterator(*this); }
-
-    constexpr bool operator==(biterator const &other) const noexcept
-    {
-      return std::addressof(_ref) == std::addressof(other._ref) &&
-             _id == other._id && _offset == other._offset;
-    }
-    constexpr bool operator!=(biterator const &other) const noexcept
-    {
-      return !operator==(other);
-    }
-  };
+/* Read-only view with dynamic_bitmap's chunk layout; see bitmap_file.hh */
+using dynamic_bitmap_view = bitmap_view<std::uint64_t const>;
 
-  biterator begin()
-  {
-    ChunkId id(0);
-    ChunkOffset offset(0);
-    for (; id < CHUNK_COUNT; ++id) {
-      ChunkT chunk = _bit_array[id];
-      if (chunk) {
-        offset = bitops::countr_zero(chunk);
-        break;
-      }
-    }
-    return biterator(*this, id, offset);
-  }
-
-  biterator end() { return biterator(*this, ChunkId(CHUNK_COUNT), 0); }
+namespace bitmap_expr
+{
+template <std::size_t N, class Allocator>
+struct is_leaf<bitmap<N, Allocator>> : std::true_type {
+};
 
-  template <class CharT = char, class Traits = std::char_traits<CharT>,
-            class Allocator = std::allocator<CharT>>
-  std::basic_string<CharT, Traits, Allocator>
-  to_string(CharT zero = CharT('0'), CharT one = CharT('1')) const
-  {
-    return std::bitset<N>(*this).template to_string<CharT, Traits, Allocator>(
-        zero, one);
-  }
+/* Views over dynamic_bitmap-style chunks evaluate to a dynamic_bitmap */
+template <>
+struct is_leaf<bitmap_view<std::uint64_t>> : std::true_type {
 };
+template <>
+struct is_leaf<bitmap_view<std::uint64_t const>> : std::true_type {
+};
+template <class ChunkT>
+struct result_of<bitmap_view<ChunkT>> {
+  using type = bitmap<0>;
+};
+} // namespace bitmap_expr
 
-template <std::size_t N>
-bitmap<N>
-operator&(bitmap<N> const &lhs, bitmap<N> const &rhs)
+namespace detail
 {
-  return bitmap(lhs) &= rhs;
-}
-template <std::size_t N>
-bitmap<N>
-operator|(bitmap<N> const &lhs, bitmap<N> const &rhs)
+inline bool
+hex_stream(std::ios_base const &s)
 {
-  return bitmap(lhs) |= rhs;
+  return (s.flags() & std::ios_base::basefield) == std::ios_base::hex;
 }
-template <std::size_t N>
-bitmap<N>
-operator^(bitmap<N> const &lhs, bitmap<N> const &rhs)
+
+/* Extracts up to max digits (hex under std::hex, else binary) after
+ * skipping whitespace, as std::bitset's operator>> does: stops at the first
+ * other character, and sets failbit if there is no digit */
+template <class CharT, class Traits>
+std::string
+extract_digits(std::basic_istream<CharT, Traits> &is, std::size_t max)
 {
-  return bitmap(lhs) ^= rhs;
+  std::string ret;
+  typename std::basic_istream<CharT, Traits>::sentry sentry(is);
+  if (!sentry) return ret;
+  bool const hex = hex_stream(is);
+  auto const &ct = std::use_facet<std::ctype<CharT>>(is.getloc());
+  auto *const buf = is.rdbuf();
+  std::ios_base::iostate state = std::ios_base::goodbit;
+  for (; ret.size() < max; buf->sbumpc()) {
+    auto const c = buf->sgetc();
+    if (Traits::eq_int_type(c, Traits::eof())) {
+      state |= std::ios_base::eofbit;
+      break;
+    }
+    char const d = ct.narrow(Traits::to_char_type(c), '\0');
+    if (!(hex ? std::isxdigit((unsigned char)d) : d == '0' || d == '1')) break;
+    ret += d;
+  }
+  if (ret.empty()) state |= std::ios_base::failbit;
+  is.setstate(state);
+  return ret;
 }
+} // namespace detail
 
-template <class CharT, class Traits, std::size_t N>
+/* Binary, or hex under std::hex (in capitals with std::uppercase) */
+template <class CharT, class Traits, std::size_t N, class Allocator>
 std::basic_ostream<CharT, Traits> &
-operator<<(std::basic_ostream<CharT, Traits> &os, const bitmap<N> &x)
+operator<<(std::basic_ostream<CharT, Traits> &os,
+           const bitmap<N, Allocator> &x)
 {
-  os << std::bitset<N>(x);
-  return os;
+  auto const &ct = std::use_facet<std::ctype<CharT>>(os.getloc());
+  if (!detail::hex_stream(os))
+    return os << x.template to_string<CharT, Traits>(ct.widen('0'),
+                                                     ct.widen('1'));
+  std::string s(x.chars_size(16), '\0');
+  x.to_chars(&s[0], &s[0] + s.size(), 16,
+             os.flags() & std::ios_base::uppercase);
+  if constexpr (std::is_same<CharT, char>::value) {
+    return os << s;
+  } else {
+    std::basic_string<CharT, Traits> w(s.size(), CharT());
+    ct.widen(s.data(), s.data() + s.size(), &w[0]);
+    return os << w;
+  }
 }
 
-template <class CharT, class Traits, std::size_t N>
+/* As std::bitset: reads up to as many digits as bitmap<N> holds, filling
+ * from the low bits. A dynamic_bitmap takes every digit and is resized to
+ * them. Hex under std::hex. */
+template <class CharT, class Traits, std::size_t N, class Allocator>
 std::basic_istream<CharT, Traits> &
-operator>>(std::basic_istream<CharT, Traits> &is, bitmap<N> &x)
+operator>>(std::basic_istream<CharT, Traits> &is, bitmap<N, Allocator> &x)
 {
-  std::bitset<N> s;
-  is >> s;
-  x = s;
+  int const base = detail::hex_stream(is) ? 16 : 2;
+  std::string const s =
+      detail::extract_digits(is, N ? x.chars_size(base) : std::size_t(-1));
+  if (s.empty()) return is;
+  if constexpr (N == 0) x.resize(base == 16 ? 4 * s.size() : s.size());
+  if (x.from_chars(s.data(), s.data() + s.size(), base).ec != std::errc())
+    is.setstate(std::ios_base::failbit);
   return is;
 }
 } // namespace util
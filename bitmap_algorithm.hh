@@ -0,0 +1,234 @@
+/* Fused multi-bitmap algorithms
+ *
+ * intersect_count(a, b), union_count(a, b) and difference_count(a, b) are
+ * |a & b|, |a | b| and |a & ~b| in one pass over both operands, without
+ * building the result. The k-way forms take an iterator range of bitmaps:
+ * and_all(out, first, last) and or_all(out, first, last) write the
+ * intersection or union into out, and intersect_count(first, last) and
+ * union_count(first, last) count it. They work through the operands a block
+ * at a time so the running result stays in L1 while each input streams
+ * past once; none of them allocates.
+ *
+ * Operands must all be the same size, as for &=. Any basic_bitmap works;
+ * 64-bit chunks go through the vector kernels.
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+#include "util/basic_bitmap.hh"
+#include "util/bit.hh"
+#include "util/bit_kernels.hh"
+#include "util/bitmap_storage.hh"
+
+namespace util
+{
+namespace detail
+{
+/* Chunks per block of the k-way algorithms: 4 KiB of 64-bit chunks */
+constexpr std::size_t KWAY_BLOCK = 512;
+
+template <class S1, class S2>
+using enable_same_chunks = std::enable_if_t<std::is_same<
+    typename S1::chunk_type, typename S2::chunk_type>::value>;
+
+/* Enables the k-way overloads for iterators (and not for bitmaps) */
+template <class It>
+using enable_iterator =
+    std::void_t<typename std::iterator_traits<It>::iterator_category>;
+
+template <class It>
+using iterated_chunk_t = typename std::decay_t<decltype(*std::declval<
+                                                        It>())>::chunk_type;
+
+template <class ChunkT>
+constexpr bool is_kernel_chunk = std::is_same<ChunkT, kernels::chunk_t>::value;
+
+template <class ChunkT>
+constexpr bool
+use_kernels(std::size_t n)
+{
+  return is_kernel_chunk<ChunkT> && !kernels::is_constant_evaluated() &&
+         n >= kernels::MIN_CHUNKS;
+}
+
+/* Sums popcount(op(a[i], b[i])) */
+template <class ChunkT, class Op>
+constexpr std::size_t
+count2(ChunkT const *a, ChunkT const *b, std::size_t n, Op op) noexcept
+{
+  std::size_t cnt = 0;
+  for (std::size_t i = 0; i < n; ++i)
+    cnt += bitops::popcount((ChunkT)op(a[i], b[i]));
+  return cnt;
+}
+
+template <class ChunkT>
+inline void
+and_block(ChunkT *dst, ChunkT const *src, std::size_t n) noexcept
+{
+  if constexpr (is_kernel_chunk<ChunkT>)
+    if (n >= kernels::MIN_CHUNKS)
+      return kernels::active().and_assign(dst, src, n);
+  for (std::size_t i = 0; i < n; ++i) dst[i] &= src[i];
+}
+
+template <class ChunkT>
+inline void
+or_block(ChunkT *dst, ChunkT const *src, std::size_t n) noexcept
+{
+  if constexpr (is_kernel_chunk<ChunkT>)
+    if (n >= kernels::MIN_CHUNKS)
+      return kernels::active().or_assign(dst, src, n);
+  for (std::size_t i = 0; i < n; ++i) dst[i] |= src[i];
+}
+
+template <class ChunkT>
+inline std::size_t
+count_block(ChunkT const *src, std::size_t n) noexcept
+{
+  if constexpr (is_kernel_chunk<ChunkT>)
+    if (n >= kernels::MIN_CHUNKS) return kernels::active().count(src, n);
+  std::size_t cnt = 0;
+  for (std::size_t i = 0; i < n; ++i) cnt += bitops::popcount(src[i]);
+  return cnt;
+}
+
+/* For each block of chunks [i, i + len) of the nonempty range of operands,
+ * combines the operands' blocks into a buffer and calls block(buf, i, len).
+ * The buffer, not the output, is the accumulator, so an output that is also
+ * an operand is read before it is written. */
+template <class It, class Combine, class Block>
+void
+kway(It first, It last, Combine combine, Block block)
+{
+  using access = bitmap_storage::access;
+  using ChunkT = iterated_chunk_t<It>;
+  ChunkT buf[KWAY_BLOCK];
+  std::size_t const n = access::chunk_count(*first);
+  for (std::size_t i = 0; i < n; i += KWAY_BLOCK) {
+    std::size_t const len = std::min(KWAY_BLOCK, n - i);
+    ChunkT const *src = access::chunks(*first);
+    std::copy(src + i, src + i + len, buf);
+    for (It it = std::next(first); it != last; ++it)
+      combine(buf, access::chunks(*it) + i, len);
+    block((ChunkT const *)buf, i, len);
+  }
+}
+} // namespace detail
+
+/* |a & b| */
+template <class D1, class S1, class D2, class S2,
+          class = detail::enable_same_chunks<S1, S2>>
+constexpr std::size_t
+intersect_count(basic_bitmap<D1, S1> const &a, basic_bitmap<D2, S2> const &b)
+{
+  using access = bitmap_storage::access;
+  using ChunkT = typename S1::chunk_type;
+  std::size_t const n = access::chunk_count(a);
+  if constexpr (detail::is_kernel_chunk<ChunkT>)
+    if (detail::use_kernels<ChunkT>(n))
+      return kernels::active().and_count(access::chunks(a), access::chunks(b),
+                                         n);
+  return detail::count2(access::chunks(a), access::chunks(b), n,
+                        [](ChunkT x, ChunkT y) { return x & y; });
+}
+
+/* |a | b| */
+template <class D1, class S1, class D2, class S2,
+          class = detail::enable_same_chunks<S1, S2>>
+constexpr std::size_t
+union_count(basic_bitmap<D1, S1> const &a, basic_bitmap<D2, S2> const &b)
+{
+  using access = bitmap_storage::access;
+  using ChunkT = typename S1::chunk_type;
+  std::size_t const n = access::chunk_count(a);
+  if constexpr (detail::is_kernel_chunk<ChunkT>)
+    if (detail::use_kernels<ChunkT>(n))
+      return kernels::active().or_count(access::chunks(a), access::chunks(b),
+                                        n);
+  return detail::count2(access::chunks(a), access::chunks(b), n,
+                        [](ChunkT x, ChunkT y) { return x | y; });
+}
+
+/* |a & ~b|, the bits of a not in b */
+template <class D1, class S1, class D2, class S2,
+          class = detail::enable_same_chunks<S1, S2>>
+constexpr std::size_t
+difference_count(basic_bitmap<D1, S1> const &a, basic_bitmap<D2, S2> const &b)
+{
+  using access = bitmap_storage::access;
+  using ChunkT = typename S1::chunk_type;
+  std::size_t const n = access::chunk_count(a);
+  if constexpr (detail::is_kernel_chunk<ChunkT>)
+    if (detail::use_kernels<ChunkT>(n))
+      return kernels::active().andnot_count(access::chunks(a),
+                                            access::chunks(b), n);
+  return detail::count2(access::chunks(a), access::chunks(b), n,
+                        [](ChunkT x, ChunkT y) { return x & ~y; });
+}
+
+/* out = *first & ... & *(last - 1); all ones for an empty range. out may be
+ * one of the operands. */
+template <class D, class S, class It, class = detail::enable_iterator<It>>
+D &
+and_all(basic_bitmap<D, S> &out, It first, It last)
+{
+  using ChunkT = typename S::chunk_type;
+  static_assert(std::is_same<detail::iterated_chunk_t<It>, ChunkT>::value);
+  if (first == last) return out.set();
+  ChunkT *p = bitmap_storage::access::chunks(out);
+  detail::kway(first, last, detail::and_block<ChunkT>,
+               [p](ChunkT const *buf, std::size_t i, std::size_t len) {
+                 std::copy(buf, buf + len, p + i);
+               });
+  return static_cast<D &>(out);
+}
+
+/* out = *first | ... | *(last - 1); all zeros for an empty range. out may be
+ * one of the operands. */
+template <class D, class S, class It, class = detail::enable_iterator<It>>
+D &
+or_all(basic_bitmap<D, S> &out, It first, It last)
+{
+  using ChunkT = typename S::chunk_type;
+  static_assert(std::is_same<detail::iterated_chunk_t<It>, ChunkT>::value);
+  if (first == last) return out.reset();
+  ChunkT *p = bitmap_storage::access::chunks(out);
+  detail::kway(first, last, detail::or_block<ChunkT>,
+               [p](ChunkT const *buf, std::size_t i, std::size_t len) {
+                 std::copy(buf, buf + len, p + i);
+               });
+  return static_cast<D &>(out);
+}
+
+/* |*first & ... & *(last - 1)|; the range must not be empty */
+template <class It, class = detail::enable_iterator<It>>
+std::size_t
+intersect_count(It first, It last)
+{
+  using ChunkT = detail::iterated_chunk_t<It>;
+  std::size_t cnt = 0;
+  detail::kway(first, last, detail::and_block<ChunkT>,
+               [&](ChunkT const *buf, std::size_t, std::size_t len) {
+                 cnt += detail::count_block(buf, len);
+               });
+  return cnt;
+}
+
+/* |*first | ... | *(last - 1)|; the range must not be empty */
+template <class It, class = detail::enable_iterator<It>>
+std::size_t
+union_count(It first, It last)
+{
+  using ChunkT = detail::iterated_chunk_t<It>;
+  std::size_t cnt = 0;
+  detail::kway(first, last, detail::or_block<ChunkT>,
+               [&](ChunkT const *buf, std::size_t, std::size_t len) {
+                 cnt += detail::count_block(buf, len);
+               });
+  return cnt;
+}
+} // namespace util
@@ -0,0 +1,267 @@
+/* Lazy bitwise expressions over bitmap and dynamic_bitmap
+ *
+ * `a & b`, `a | b`, `a ^ b` and `~a` build small expression objects instead
+ * of full bitmaps. Nothing is computed until the expression is assigned to a
+ * bitmap, used as the right-hand side of &=, |= or ^=, or asked for
+ * count()/any()/none()/all(); each of those is one fused pass over the
+ * chunks with no temporaries.
+ *
+ * Expressions also compare with == and != against bitmaps and other
+ * expressions (chunk by chunk, without a temporary), and eval() or
+ * to_string() materialize them, so code written when these operators
+ * returned bitmaps keeps working. Other bitmap members need an explicit
+ * eval() or conversion, e.g. `(a & b).eval().test(i)`.
+ *
+ * Expressions hold references to their bitmap operands, so
+ * `auto e = a & b;` must not outlive a or b.
+ */
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "util/bit.hh"
+#include "util/bitmap_storage.hh"
+
+namespace util
+{
+namespace bitmap_expr
+{
+
+/* Specialized to std::true_type by each bitmap type */
+template <class T>
+struct is_leaf : std::false_type {
+};
+
+template <class T>
+struct is_node : std::false_type {
+};
+
+/* The bitmap type an expression over leaf T evaluates to; specialized for
+ * types, such as views, that can't hold a result themselves */
+template <class T>
+struct result_of {
+  using type = T;
+};
+
+template <class Derived>
+class expr
+{
+private:
+  constexpr Derived const &self() const
+  {
+    return static_cast<Derived const &>(*this);
+  }
+
+public:
+  /* The bitmap this expression evaluates to */
+  constexpr auto eval() const
+  {
+    return typename Derived::result_type(self());
+  }
+
+  template <class CharT = char, class Traits = std::char_traits<CharT>,
+            class Allocator = std::allocator<CharT>>
+  std::basic_string<CharT, Traits, Allocator>
+  to_string(CharT zero = CharT('0'), CharT one = CharT('1')) const
+  {
+    return eval().template to_string<CharT, Traits, Allocator>(zero, one);
+  }
+
+  constexpr std::size_t count() const noexcept
+  {
+    using chunk_type = typename Derived::chunk_type;
+    std::size_t const n = self().chunk_count();
+    if (n == 0) return 0;
+    std::size_t cnt = 0;
+    for (std::size_t i = 0; i < n - 1; ++i)
+      cnt += bitops::popcount(self().chunk(i));
+    return cnt + bitops::popcount(
+                     (chunk_type)(self().chunk(n - 1) & self().pad_mask()));
+  }
+
+  constexpr bool any() const noexcept
+  {
+    std::size_t const n = self().chunk_count();
+    if (n == 0) return false;
+    for (std::size_t i = 0; i < n - 1; ++i)
+      if (self().chunk(i)) return true;
+    return self().chunk(n - 1) & self().pad_mask();
+  }
+
+  constexpr bool none() const noexcept { return !any(); }
+
+  constexpr bool all() const noexcept
+  {
+    using chunk_type = typename Derived::chunk_type;
+    std::size_t const n = self().chunk_count();
+    if (n == 0) return true;
+    for (std::size_t i = 0; i < n - 1; ++i)
+      if ((chunk_type)~self().chunk(i)) return false;
+    return (self().chunk(n - 1) & self().pad_mask()) == self().pad_mask();
+  }
+};
+
+/* Wraps a bitmap operand */
+template <class B>
+class leaf
+{
+private:
+  using access = bitmap_storage::access;
+  B const &_ref;
+
+public:
+  using result_type = typename result_of<B>::type;
+  using chunk_type = typename B::chunk_type;
+
+  constexpr leaf(B const &ref) : _ref(ref) {}
+  constexpr std::size_t size() const { return _ref.size(); }
+  constexpr std::size_t chunk_count() const
+  {
+    return access::chunk_count(_ref);
+  }
+  constexpr chunk_type pad_mask() const { return access::pad_mask(_ref); }
+  constexpr chunk_type chunk(std::size_t i) const
+  {
+    return access::chunks(_ref)[i];
+  }
+};
+
+template <class T>
+using node_t =
+    typename std::conditional<is_leaf<T>::value, leaf<T>, T>::type;
+
+template <class E>
+class not_ : public expr<not_<E>>
+{
+private:
+  E _e;
+
+public:
+  using result_type = typename E::result_type;
+  using chunk_type = typename E::chunk_type;
+
+  constexpr explicit not_(E const &e) : _e(e) {}
+  constexpr std::size_t size() const { return _e.size(); }
+  constexpr std::size_t chunk_count() const { return _e.chunk_count(); }
+  constexpr chunk_type pad_mask() const { return _e.pad_mask(); }
+  constexpr chunk_type chunk(std::size_t i) const
+  {
+    return (chunk_type)~_e.chunk(i);
+  }
+};
+
+template <class Op, class L, class R>
+class binary : public expr<binary<Op, L, R>>
+{
+private:
+  L _l;
+  R _r;
+
+public:
+  using result_type = typename L::result_type;
+  using chunk_type = typename L::chunk_type;
+
+  constexpr binary(L const &l, R const &r) : _l(l), _r(r) {}
+  constexpr std::size_t size() const { return _l.size(); }
+  constexpr std::size_t chunk_count() const { return _l.chunk_count(); }
+  constexpr chunk_type pad_mask() const { return _l.pad_mask(); }
+  constexpr chunk_type chunk(std::size_t i) const
+  {
+    return (chunk_type)Op()(_l.chunk(i), _r.chunk(i));
+  }
+};
+
+template <class E>
+struct is_node<not_<E>> : std::true_type {
+};
+template <class Op, class L, class R>
+struct is_node<binary<Op, L, R>> : std::true_type {
+};
+
+template <class T>
+struct is_operand
+    : std::integral_constant<bool, is_leaf<T>::value || is_node<T>::value> {
+};
+
+/* Enables a bitmap member template for expressions that evaluate to B */
+template <class E, class B>
+using enable_for = typename std::enable_if<
+    is_node<E>::value && std::is_same<typename E::result_type, B>::value>::type;
+
+template <class L, class R>
+using enable_binary = typename std::enable_if<
+    is_operand<L>::value && is_operand<R>::value &&
+    std::is_same<typename node_t<L>::result_type,
+                 typename node_t<R>::result_type>::value>::type;
+
+/* Enables a comparison of two operands where at least one is a node; two
+ * bitmaps compare through their own members */
+template <class L, class R>
+using enable_compare = typename std::enable_if<
+    (is_node<L>::value || is_node<R>::value) &&
+    std::is_void<enable_binary<L, R>>::value>::type;
+
+template <class L, class R>
+constexpr bool
+equal(L const &l, R const &r) noexcept
+{
+  if (l.size() != r.size()) return false;
+  std::size_t const n = l.chunk_count();
+  if (n == 0) return true;
+  for (std::size_t i = 0; i < n - 1; ++i)
+    if (l.chunk(i) != r.chunk(i)) return false;
+  return ((l.chunk(n - 1) ^ r.chunk(n - 1)) & l.pad_mask()) == 0;
+}
+
+} // namespace bitmap_expr
+
+template <class E,
+          class = std::enable_if_t<bitmap_expr::is_operand<E>::value>>
+constexpr bitmap_expr::not_<bitmap_expr::node_t<E>>
+operator~(E const &e) noexcept
+{
+  return bitmap_expr::not_<bitmap_expr::node_t<E>>(e);
+}
+
+#define bitmap_op(op, fn)                                                      \
+  template <class L, class R, class = bitmap_expr::enable_binary<L, R>>        \
+  constexpr bitmap_expr::binary<fn, bitmap_expr::node_t<L>,                    \
+                                bitmap_expr::node_t<R>>                        \
+  operator op(L const &lhs, R const &rhs) noexcept                             \
+  {                                                                            \
+    return {lhs, rhs};                                                         \
+  }
+
+bitmap_op(&, std::bit_and<>);
+bitmap_op(|, std::bit_or<>);
+bitmap_op(^, std::bit_xor<>);
+#undef bitmap_op
+
+template <class L, class R, class = bitmap_expr::enable_compare<L, R>>
+constexpr bool
+operator==(L const &lhs, R const &rhs) noexcept
+{
+  return bitmap_expr::equal(bitmap_expr::node_t<L>(lhs),
+                            bitmap_expr::node_t<R>(rhs));
+}
+
+template <class L, class R, class = bitmap_expr::enable_compare<L, R>>
+constexpr bool
+operator!=(L const &lhs, R const &rhs) noexcept
+{
+  return !(lhs == rhs);
+}
+
+template <class CharT, class Traits, class E,
+          class = std::enable_if_t<bitmap_expr::is_node<E>::value>>
+std::basic_ostream<CharT, Traits> &
+operator<<(std::basic_ostream<CharT, Traits> &os, E const &e)
+{
+  return os << typename E::result_type(e);
+}
+
+} // namespace util
@@ -0,0 +1,249 @@
+/* On-disk format for dynamic_bitmap, and zero-copy memory-mapped loading
+ *
+ * A file is a 64-byte bitmap_file_header followed directly by the chunks,
+ * exactly as dynamic_bitmap lays them out in memory: 64-bit words in the
+ * writer's byte order, bit i in bit i % 64 of word i / 64, padding bits
+ * clear. Because the header is 64 bytes, mapped chunks are 64-byte aligned.
+ *
+ * write_bitmap() and read_bitmap() go through streams and always check the
+ * checksum; read_bitmap() also accepts files of the other byte order.
+ * mapped_bitmap maps a file read-only and hands out a dynamic_bitmap_view
+ * over the mapped pages, so test(), count(), iteration and expressions run
+ * on the file without reading it up front. Opening it only checks the
+ * header; pass verify = true (or call verify()) to also check the checksum,
+ * which reads every page.
+ */
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "util/bit.hh"
+#include "util/bitmap.hh"
+#include "util/bitmap_storage.hh"
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define UTIL_BITMAP_FILE_MMAP 1
+#endif
+
+namespace util
+{
+struct bitmap_file_header {
+  constexpr static char MAGIC[8] = {'U', 'T', 'I', 'L', 'B', 'M', 'P', '\0'};
+  constexpr static std::uint32_t VERSION = 1;
+  /* Stored as written; reads back swapped on a machine of the other order */
+  constexpr static std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t chunk_bits;
+  std::uint32_t header_size; /* offset of the chunks */
+  std::uint64_t size;        /* in bits */
+  std::uint64_t chunk_count;
+  std::uint64_t checksum; /* bitmap_checksum() of the chunks */
+  std::uint64_t reserved[2];
+};
+static_assert(sizeof(bitmap_file_header) == 64);
+static_assert(std::is_trivially_copyable<bitmap_file_header>::value);
+
+/* Word-at-a-time FNV-1a; catches any single flipped bit */
+inline std::uint64_t
+bitmap_checksum(std::uint64_t const *chunks, std::size_t n) noexcept
+{
+  std::uint64_t h = 0xcbf29ce484222325;
+  for (std::size_t i = 0; i < n; ++i) h = (h ^ chunks[i]) * 0x100000001b3;
+  return h;
+}
+
+namespace detail
+{
+/* Validates h (already in native order) against the bytes available after
+ * it, or throws */
+inline void
+check_header(bitmap_file_header const &h, std::uint64_t available)
+{
+  using H = bitmap_file_header;
+  if (std::memcmp(h.magic, H::MAGIC, sizeof(H::MAGIC)))
+    throw std::runtime_error("bitmap file: bad magic");
+  if (h.version != H::VERSION)
+    throw std::runtime_error("bitmap file: unsupported version");
+  if (h.chunk_bits != 64 || h.header_size != sizeof(H))
+    throw std::runtime_error("bitmap file: unsupported layout");
+  /* chunk_count is bounded first so 64 * chunk_count cannot overflow; then
+   * size must fill all but at most 63 bits of it */
+  if (h.chunk_count > available / sizeof(std::uint64_t) ||
+      h.size > 64 * h.chunk_count || 64 * h.chunk_count - h.size >= 64)
+    throw std::runtime_error("bitmap file: truncated or bad size");
+}
+
+inline void
+check_padding(bitmap_file_header const &h, std::uint64_t const *chunks)
+{
+  /* check_header() guarantees 0 <= pad < 64 */
+  std::uint64_t const pad = 64 * h.chunk_count - h.size;
+  if (h.chunk_count && pad && (chunks[h.chunk_count - 1] >> (64 - pad)))
+    throw std::runtime_error("bitmap file: padding bits set");
+}
+} // namespace detail
+
+template <class D, class S,
+          class = std::enable_if_t<
+              std::is_same<typename S::chunk_type, std::uint64_t>::value>>
+std::ostream &
+write_bitmap(std::ostream &os, basic_bitmap<D, S> const &bitmap)
+{
+  using access = bitmap_storage::access;
+  std::uint64_t const *chunks = access::chunks(bitmap);
+  std::size_t const n = access::chunk_count(bitmap);
+
+  bitmap_file_header h{};
+  std::memcpy(h.magic, bitmap_file_header::MAGIC, sizeof(h.magic));
+  h.version = bitmap_file_header::VERSION;
+  h.byte_order = bitmap_file_header::BYTE_ORDER_MARK;
+  h.chunk_bits = 64;
+  h.header_size = sizeof(h);
+  h.size = bitmap.size();
+  h.chunk_count = n;
+  h.checksum = bitmap_checksum(chunks, n);
+
+  os.write((char const *)&h, sizeof(h));
+  os.write((char const *)chunks, n * sizeof(std::uint64_t));
+  return os;
+}
+
+inline dynamic_bitmap
+read_bitmap(std::istream &is)
+{
+  bitmap_file_header h;
+  if (!is.read((char *)&h, sizeof(h)))
+    throw std::runtime_error("bitmap file: truncated header");
+  bool const swapped = h.byte_order != bitmap_file_header::BYTE_ORDER_MARK;
+  if (swapped) {
+    if (bitops::byteswap(h.byte_order) != bitmap_file_header::BYTE_ORDER_MARK)
+      throw std::runtime_error("bitmap file: bad byte order mark");
+    for (auto *f : {&h.version, &h.byte_order, &h.chunk_bits, &h.header_size})
+      *f = bitops::byteswap(*f);
+    for (auto *f : {&h.size, &h.chunk_count, &h.checksum})
+      *f = bitops::byteswap(*f);
+  }
+  detail::check_header(h, std::uint64_t(-1));
+
+  dynamic_bitmap ret(h.size);
+  std::uint64_t *chunks = bitmap_storage::access::chunks(ret);
+  if (!is.read((char *)chunks, h.chunk_count * sizeof(std::uint64_t)))
+    throw std::runtime_error("bitmap file: truncated");
+  if (swapped)
+    for (std::size_t i = 0; i < h.chunk_count; ++i)
+      chunks[i] = bitops::byteswap(chunks[i]);
+  if (bitmap_checksum(chunks, h.chunk_count) != h.checksum)
+    throw std::runtime_error("bitmap file: checksum mismatch");
+  detail::check_padding(h, chunks);
+  return ret;
+}
+
+#if UTIL_BITMAP_FILE_MMAP
+/* A bitmap file mapped read-only; files of the other byte order can't be
+ * used in place and are rejected */
+class mapped_bitmap
+{
+private:
+  void *_map;
+  std::size_t _length;
+
+  bitmap_file_header const &hdr() const
+  {
+    return *(bitmap_file_header const *)_map;
+  }
+  std::uint64_t const *chunks() const
+  {
+    return (std::uint64_t const *)((char const *)_map + hdr().header_size);
+  }
+
+public:
+  explicit mapped_bitmap(char const *path, bool verify = false)
+      : _map(nullptr), _length(0)
+  {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+      int err = errno;
+      ::close(fd);
+      throw std::system_error(err, std::generic_category(), path);
+    }
+    _length = st.st_size;
+    if (_length < sizeof(bitmap_file_header)) {
+      ::close(fd);
+      throw std::runtime_error("bitmap file: truncated header");
+    }
+    void *map = ::mmap(nullptr, _length, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    ::close(fd);
+    if (map == MAP_FAILED)
+      throw std::system_error(err, std::generic_category(), path);
+    _map = map;
+
+    try {
+      if (hdr().byte_order != bitmap_file_header::BYTE_ORDER_MARK)
+        throw std::runtime_error("bitmap file: foreign byte order");
+      detail::check_header(hdr(), _length - sizeof(bitmap_file_header));
+      detail::check_padding(hdr(), chunks());
+      if (verify && !this->verify())
+        throw std::runtime_error("bitmap file: checksum mismatch");
+    } catch (...) {
+      ::munmap(_map, _length);
+      throw;
+    }
+  }
+  explicit mapped_bitmap(std::string const &path, bool verify = false)
+      : mapped_bitmap(path.c_str(), verify)
+  {
+  }
+
+  mapped_bitmap(mapped_bitmap &&other) noexcept
+      : _map(other._map), _length(other._length)
+  {
+    other._map = nullptr;
+  }
+  mapped_bitmap &operator=(mapped_bitmap &&other) noexcept
+  {
+    std::swap(_map, other._map);
+    std::swap(_length, other._length);
+    return *this;
+  }
+  mapped_bitmap(mapped_bitmap const &) = delete;
+  mapped_bitmap &operator=(mapped_bitmap const &) = delete;
+  ~mapped_bitmap()
+  {
+    if (_map) ::munmap(_map, _length);
+  }
+
+  bitmap_file_header const &header() const { return hdr(); }
+
+  /* Valid while this object is alive */
+  dynamic_bitmap_view view() const
+  {
+    return dynamic_bitmap_view(chunks(), hdr().size);
+  }
+
+  /* Recomputes the checksum; reads the whole file */
+  bool verify() const
+  {
+    return bitmap_checksum(chunks(), hdr().chunk_count) == hdr().checksum;
+  }
+};
+#endif
+} // namespace util
@@ -0,0 +1,166 @@
+/* Multi-threaded bulk operations for very large bitmaps
+ *
+ * parallel::and_assign, or_assign, xor_assign, flip and count do the same
+ * as the basic_bitmap members, over a thread_pool. The chunks are split
+ * into one range per thread, each starting on a 64-byte boundary of the
+ * destination so no two threads write the same cache line, and each range
+ * goes through the vector kernels. count() sums per-range counts.
+ *
+ * Bitmaps under MIN_CHUNKS chunks (4M bits), or pools of one thread, run
+ * serially: below that, waking the workers costs more than the pass.
+ *
+ *   util::thread_pool pool;
+ *   util::parallel::and_assign(pool, a, b); // a &= b
+ *   std::size_t n = util::parallel::count(pool, a);
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "util/basic_bitmap.hh"
+#include "util/bit_kernels.hh"
+#include "util/bitmap_storage.hh"
+#include "util/thread_pool.hh"
+
+namespace util
+{
+namespace parallel
+{
+/* Serial below this many chunks */
+constexpr std::size_t MIN_CHUNKS = std::size_t(1) << 16;
+
+namespace detail
+{
+constexpr std::size_t LINE_CHUNKS = 64 / sizeof(kernels::chunk_t);
+
+template <class S>
+using enable_kernel_chunks = std::enable_if_t<
+    std::is_same<typename S::chunk_type, kernels::chunk_t>::value>;
+
+/* Calls f(t, first, last) for cache-line-aligned subranges of p[0, n), the
+ * t-th of at most pool.size(), on the pool; or returns false if n is too
+ * small to be worth it */
+template <class F>
+bool
+split(thread_pool &pool, kernels::chunk_t const *p, std::size_t n, F const &f)
+{
+  std::size_t const tasks = std::min(pool.size(), n / (MIN_CHUNKS / 4));
+  if (n < MIN_CHUNKS || tasks < 2) return false;
+
+  /* Chunks before the first line boundary go to the first range */
+  std::size_t const head =
+      (-(std::uintptr_t)p / sizeof(kernels::chunk_t)) % LINE_CHUNKS;
+  std::size_t const lines = (n - head + LINE_CHUNKS - 1) / LINE_CHUNKS;
+  std::size_t const step = (lines + tasks - 1) / tasks * LINE_CHUNKS;
+  pool.run(tasks, [&](std::size_t t) {
+    std::size_t const first = t == 0 ? 0 : std::min(n, head + t * step);
+    std::size_t const last = std::min(n, head + (t + 1) * step);
+    if (first < last) f(t, first, last);
+  });
+  return true;
+}
+} // namespace detail
+
+/* a &= b; b must be the same size */
+template <class D1, class S1, class D2, class S2,
+          class = detail::enable_kernel_chunks<S1>,
+          class = detail::enable_kernel_chunks<S2>>
+D1 &
+and_assign(thread_pool &pool, basic_bitmap<D1, S1> &a,
+           basic_bitmap<D2, S2> const &b)
+{
+  using access = bitmap_storage::access;
+  kernels::chunk_t *p = access::chunks(a);
+  kernels::chunk_t const *q = access::chunks(b);
+  if (!detail::split(pool, p, access::chunk_count(a),
+                     [&](std::size_t, std::size_t first, std::size_t last) {
+                       kernels::active().and_assign(p + first, q + first,
+                                                    last - first);
+                     }))
+    a &= b;
+  return static_cast<D1 &>(a);
+}
+
+/* a |= b; b must be the same size */
+template <class D1, class S1, class D2, class S2,
+          class = detail::enable_kernel_chunks<S1>,
+          class = detail::enable_kernel_chunks<S2>>
+D1 &
+or_assign(thread_pool &pool, basic_bitmap<D1, S1> &a,
+          basic_bitmap<D2, S2> const &b)
+{
+  using access = bitmap_storage::access;
+  kernels::chunk_t *p = access::chunks(a);
+  kernels::chunk_t const *q = access::chunks(b);
+  if (!detail::split(pool, p, access::chunk_count(a),
+                     [&](std::size_t, std::size_t first, std::size_t last) {
+                       kernels::active().or_assign(p + first, q + first,
+                                                   last - first);
+                     }))
+    a |= b;
+  return static_cast<D1 &>(a);
+}
+
+/* a ^= b; b must be the same size */
+template <class D1, class S1, class D2, class S2,
+          class = detail::enable_kernel_chunks<S1>,
+          class = detail::enable_kernel_chunks<S2>>
+D1 &
+xor_assign(thread_pool &pool, basic_bitmap<D1, S1> &a,
+           basic_bitmap<D2, S2> const &b)
+{
+  using access = bitmap_storage::access;
+  kernels::chunk_t *p = access::chunks(a);
+  kernels::chunk_t const *q = access::chunks(b);
+  if (!detail::split(pool, p, access::chunk_count(a),
+                     [&](std::size_t, std::size_t first, std::size_t last) {
+                       kernels::active().xor_assign(p + first, q + first,
+                                                    last - first);
+                     }))
+    a ^= b;
+  return static_cast<D1 &>(a);
+}
+
+template <class D, class S, class = detail::enable_kernel_chunks<S>>
+D &
+flip(thread_pool &pool, basic_bitmap<D, S> &a)
+{
+  using access = bitmap_storage::access;
+  kernels::chunk_t *p = access::chunks(a);
+  std::size_t const n = access::chunk_count(a);
+  if (!detail::split(pool, p, n,
+                     [&](std::size_t, std::size_t first, std::size_t last) {
+                       kernels::active().flip(p + first, last - first);
+                     }))
+    return a.flip();
+  p[n - 1] &= access::pad_mask(a);
+  return static_cast<D &>(a);
+}
+
+template <class D, class S, class = detail::enable_kernel_chunks<S>>
+std::size_t
+count(thread_pool &pool, basic_bitmap<D, S> const &a)
+{
+  using access = bitmap_storage::access;
+  kernels::chunk_t const *p = access::chunks(a);
+
+  /* One partial count per range, each on its own cache line */
+  struct alignas(64) partial {
+    std::size_t count;
+  };
+  std::vector<partial> counts(pool.size(), partial{0});
+  if (!detail::split(pool, p, access::chunk_count(a),
+                     [&](std::size_t t, std::size_t first, std::size_t last) {
+                       counts[t].count =
+                           kernels::active().count(p + first, last - first);
+                     }))
+    return a.count();
+  std::size_t cnt = 0;
+  for (auto const &c : counts) cnt += c.count;
+  return cnt;
+}
+} // namespace parallel
+} // namespace util
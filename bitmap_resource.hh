@@ -0,0 +1,330 @@
+/* Memory resources for short-lived bitmaps
+ *
+ * monotonic_arena hands out memory by bumping a pointer through chained
+ * blocks and never frees individual allocations; release() drops everything
+ * at once. size_class_pool keeps one free list per power-of-two size and
+ * recycles blocks, for bitmaps that come and go within a longer-lived scope.
+ * Both are std::pmr::memory_resource, so they work with
+ * pmr::dynamic_bitmap, and both can also be used through
+ * resource_allocator, which calls them directly instead of through the
+ * virtual interface:
+ *
+ *   util::monotonic_arena arena;
+ *   util::arena_bitmap a(1 << 20, arena), b(1 << 20, arena);
+ *   util::arena_bitmap c(a & b, arena);
+ *   ...
+ *   arena.release(); // after a, b and c are gone
+ *
+ * Neither is thread-safe; use one per thread or per query.
+ */
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+#include "util/bit.hh"
+#include "util/bitmap.hh"
+
+namespace util
+{
+class monotonic_arena : public std::pmr::memory_resource
+{
+private:
+  struct block {
+    block *next;
+    std::size_t size; /* including this header */
+  };
+
+  std::pmr::memory_resource *_upstream;
+  block *_blocks;
+  char *_cur;
+  char *_end;
+  std::size_t _next_size;
+
+  void *grow(std::size_t bytes, std::size_t align)
+  {
+    std::size_t const need = sizeof(block) + bytes + align;
+    std::size_t const size = std::max(_next_size, need);
+    block *b = (block *)_upstream->allocate(size, alignof(std::max_align_t));
+    *b = {_blocks, size};
+    _blocks = b;
+    _cur = (char *)(b + 1);
+    _end = (char *)b + size;
+    _next_size = size * 2;
+    return allocate(bytes, align);
+  }
+
+protected:
+  void *do_allocate(std::size_t bytes, std::size_t align) override
+  {
+    return allocate(bytes, align);
+  }
+  void do_deallocate(void *, std::size_t, std::size_t) override {}
+  bool do_is_equal(
+      std::pmr::memory_resource const &other) const noexcept override
+  {
+    return this == &other;
+  }
+
+public:
+  explicit monotonic_arena(
+      std::size_t initial_size = 64 * 1024,
+      std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+      : _upstream(upstream), _blocks(nullptr), _cur(nullptr), _end(nullptr),
+        _next_size(initial_size)
+  {
+  }
+  monotonic_arena(monotonic_arena const &) = delete;
+  monotonic_arena &operator=(monotonic_arena const &) = delete;
+  ~monotonic_arena()
+  {
+    release();
+    if (_blocks) _upstream->deallocate(_blocks, _blocks->size);
+  }
+
+  /* Hide memory_resource's, so calls through a monotonic_arena inline */
+  void *allocate(std::size_t bytes,
+                 std::size_t align = alignof(std::max_align_t))
+  {
+    std::uintptr_t const p =
+        ((std::uintptr_t)_cur + align - 1) & ~(std::uintptr_t)(align - 1);
+    if (_cur && p + bytes <= (std::uintptr_t)_end) {
+      _cur = (char *)(p + bytes);
+      return (void *)p;
+    }
+    return grow(bytes, align);
+  }
+  void deallocate(void *, std::size_t,
+                  std::size_t = alignof(std::max_align_t)) noexcept
+  {
+  }
+
+  /* Frees every allocation at once. The newest (largest) block is kept and
+   * reused, so an arena released once per query stops calling upstream. */
+  void release() noexcept
+  {
+    if (!_blocks) return;
+    block *b = _blocks->next;
+    while (b) {
+      block *next = b->next;
+      _upstream->deallocate(b, b->size);
+      b = next;
+    }
+    _blocks->next = nullptr;
+    _cur = (char *)(_blocks + 1);
+  }
+
+  std::pmr::memory_resource *upstream_resource() const noexcept
+  {
+    return _upstream;
+  }
+};
+
+class size_class_pool : public std::pmr::memory_resource
+{
+public:
+  constexpr static std::size_t MIN_CLASS = 16;
+  constexpr static std::size_t MAX_CLASS = 64 * 1024;
+  constexpr static std::size_t SLAB_SIZE = 256 * 1024;
+  constexpr static std::size_t SLAB_ALIGN = 64;
+
+private:
+  constexpr static int MIN_SHIFT = 4;
+  constexpr static int CLASSES = 13; /* 16 B .. 64 KiB */
+  static_assert(MIN_CLASS << (CLASSES - 1) == MAX_CLASS);
+
+  struct node {
+    node *next;
+  };
+  /* Header in front of allocations too big for a class; SLAB_ALIGN bytes so
+   * the allocation keeps the slab alignment */
+  struct alignas(SLAB_ALIGN) large {
+    large *prev;
+    large *next;
+    std::size_t size;
+  };
+
+  std::pmr::memory_resource *_upstream;
+  node *_free[CLASSES];
+  node *_slabs;
+  char *_cur;
+  char *_end;
+  large _large; /* sentinel of the list of large allocations */
+
+  static int class_of(std::size_t bytes) noexcept
+  {
+    return bytes <= MIN_CLASS ? 0 : bitops::bit_width(bytes - 1) - MIN_SHIFT;
+  }
+
+  void *carve(int c)
+  {
+    std::size_t const size = MIN_CLASS << c;
+    std::size_t const align = std::min(size, SLAB_ALIGN);
+    std::uintptr_t p =
+        ((std::uintptr_t)_cur + align - 1) & ~(std::uintptr_t)(align - 1);
+    if (!_cur || p + size > (std::uintptr_t)_end) {
+      node *s = (node *)_upstream->allocate(SLAB_SIZE, SLAB_ALIGN);
+      s->next = _slabs;
+      _slabs = s;
+      p = (std::uintptr_t)s + SLAB_ALIGN;
+      _end = (char *)s + SLAB_SIZE;
+    }
+    _cur = (char *)(p + size);
+    return (void *)p;
+  }
+
+  void *allocate_large(std::size_t bytes, std::size_t align)
+  {
+    if (align > SLAB_ALIGN)
+      return _upstream->allocate(bytes, align);
+    large *h = (large *)_upstream->allocate(sizeof(large) + bytes, SLAB_ALIGN);
+    *h = {&_large, _large.next, bytes};
+    _large.next->prev = h;
+    _large.next = h;
+    return h + 1;
+  }
+
+  void deallocate_large(void *p, std::size_t bytes, std::size_t align) noexcept
+  {
+    if (align > SLAB_ALIGN)
+      return _upstream->deallocate(p, bytes, align);
+    large *h = (large *)p - 1;
+    h->prev->next = h->next;
+    h->next->prev = h->prev;
+    _upstream->deallocate(h, sizeof(large) + bytes, SLAB_ALIGN);
+  }
+
+protected:
+  void *do_allocate(std::size_t bytes, std::size_t align) override
+  {
+    return allocate(bytes, align);
+  }
+  void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+  {
+    deallocate(p, bytes, align);
+  }
+  bool do_is_equal(
+      std::pmr::memory_resource const &other) const noexcept override
+  {
+    return this == &other;
+  }
+
+public:
+  explicit size_class_pool(
+      std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+      : _upstream(upstream), _free{}, _slabs(nullptr), _cur(nullptr),
+        _end(nullptr), _large{&_large, &_large, 0}
+  {
+  }
+  size_class_pool(size_class_pool const &) = delete;
+  size_class_pool &operator=(size_class_pool const &) = delete;
+  ~size_class_pool() { release(); }
+
+  /* Hide memory_resource's, so calls through a size_class_pool inline.
+   * Requests over MAX_CLASS bytes or SLAB_ALIGN alignment go upstream. */
+  void *allocate(std::size_t bytes,
+                 std::size_t align = alignof(std::max_align_t))
+  {
+    if (bytes > MAX_CLASS || align > SLAB_ALIGN)
+      return allocate_large(bytes, align);
+    /* Classes are aligned to their size (up to SLAB_ALIGN), so a class no
+     * smaller than align is aligned enough */
+    int const c = class_of(std::max(bytes, align));
+    if (node *n = _free[c]) {
+      _free[c] = n->next;
+      return n;
+    }
+    return carve(c);
+  }
+  void deallocate(void *p, std::size_t bytes,
+                  std::size_t align = alignof(std::max_align_t)) noexcept
+  {
+    if (bytes > MAX_CLASS || align > SLAB_ALIGN)
+      return deallocate_large(p, bytes, align);
+    int const c = class_of(std::max(bytes, align));
+    node *n = (node *)p;
+    n->next = _free[c];
+    _free[c] = n;
+  }
+
+  /* Frees every allocation at once, returning all memory upstream except
+   * over-aligned allocations, which must be deallocated individually */
+  void release() noexcept
+  {
+    while (_slabs) {
+      node *next = _slabs->next;
+      _upstream->deallocate(_slabs, SLAB_SIZE, SLAB_ALIGN);
+      _slabs = next;
+    }
+    while (_large.next != &_large) {
+      large *h = _large.next;
+      _large.next = h->next;
+      _upstream->deallocate(h, sizeof(large) + h->size, SLAB_ALIGN);
+    }
+    _large.prev = &_large;
+    std::fill(_free, _free + CLASSES, nullptr);
+    _cur = _end = nullptr;
+  }
+
+  std::pmr::memory_resource *upstream_resource() const noexcept
+  {
+    return _upstream;
+  }
+};
+
+/* Allocator over a Resource with non-virtual allocate()/deallocate(), e.g.
+ * monotonic_arena or size_class_pool. Copies share the resource. */
+template <class T, class Resource>
+class resource_allocator
+{
+private:
+  Resource *_resource;
+
+public:
+  using value_type = T;
+
+  resource_allocator(Resource &resource) noexcept : _resource(&resource) {}
+  template <class U>
+  resource_allocator(resource_allocator<U, Resource> const &other) noexcept
+      : _resource(other.resource())
+  {
+  }
+
+  T *allocate(std::size_t n)
+  {
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+      throw std::bad_array_new_length();
+    return (T *)_resource->allocate(n * sizeof(T), alignof(T));
+  }
+  void deallocate(T *p, std::size_t n) noexcept
+  {
+    _resource->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  Resource *resource() const noexcept { return _resource; }
+
+  template <class U>
+  friend bool operator==(resource_allocator const &lhs,
+                         resource_allocator<U, Resource> const &rhs) noexcept
+  {
+    return lhs.resource() == rhs.resource();
+  }
+  template <class U>
+  friend bool operator!=(resource_allocator const &lhs,
+                         resource_allocator<U, Resource> const &rhs) noexcept
+  {
+    return lhs.resource() != rhs.resource();
+  }
+};
+
+template <class T>
+using arena_allocator = resource_allocator<T, monotonic_arena>;
+template <class T>
+using pool_allocator = resource_allocator<T, size_class_pool>;
+
+using arena_bitmap = bitmap<0, arena_allocator<std::uint64_t>>;
+using pool_bitmap = bitmap<0, pool_allocator<std::uint64_t>>;
+} // namespace util
@@ -0,0 +1,327 @@
+/* Storage policies for basic_bitmap
+ *
+ * A policy owns (or refers to) a bitmap's chunk array and knows its size in
+ * bits. basic_bitmap needs only:
+ *
+ *   chunk_type, id_type      unsigned chunk and bit index types
+ *   size(), chunk_count()    in bits and chunks
+ *   data()                   pointer to chunk_count() chunks
+ *
+ * and resizable policies add resize() and get_allocator(). Bit i lives in
+ * bit i % CHUNK_BITS of chunk i / CHUNK_BITS; the padding bits past size() in
+ * the last chunk are kept clear by basic_bitmap and must be kept clear by
+ * anyone writing chunks directly.
+ */
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "util/fitted_int.hh"
+
+namespace util
+{
+namespace bitmap_storage
+{
+template <class ChunkT>
+constexpr std::size_t
+chunks_for(std::size_t bits)
+{
+  constexpr std::size_t B = std::numeric_limits<ChunkT>::digits;
+  return (bits + B - 1) / B;
+}
+
+/* Size known at compile time; chunks live in the object */
+template <class ChunkT, std::size_t N>
+class fixed
+{
+private:
+  std::array<ChunkT, chunks_for<ChunkT>(N)> _chunks;
+
+public:
+  using chunk_type = ChunkT;
+  using id_type = fitted_int::uint_fastX_t<N>;
+
+  constexpr fixed() : _chunks{} {}
+
+  constexpr static std::size_t size() { return N; }
+  constexpr static std::size_t chunk_count() { return chunks_for<ChunkT>(N); }
+  constexpr ChunkT *data() { return _chunks.data(); }
+  constexpr ChunkT const *data() const { return _chunks.data(); }
+};
+
+/* Runtime size; chunks always on the heap */
+template <class ChunkT, class Allocator = std::allocator<ChunkT>>
+class heap
+{
+private:
+  std::size_t _size;
+  std::vector<ChunkT, Allocator> _chunks;
+
+public:
+  using chunk_type = ChunkT;
+  using id_type = std::size_t;
+  using allocator_type = Allocator;
+
+  explicit heap(std::size_t size, Allocator const &alloc = Allocator())
+      : _size(size), _chunks(chunks_for<ChunkT>(size), alloc)
+  {
+  }
+
+  allocator_type get_allocator() const { return _chunks.get_allocator(); }
+
+  std::size_t size() const { return _size; }
+  std::size_t chunk_count() const { return _chunks.size(); }
+  ChunkT *data() { return _chunks.data(); }
+  ChunkT const *data() const { return _chunks.data(); }
+
+  /* New chunks are zero */
+  void resize(std::size_t size)
+  {
+    _size = size;
+    _chunks.resize(chunks_for<ChunkT>(size));
+  }
+};
+
+/* Zero-initialized array of trivial chunks, stored inline up to INLINE
+ * elements and in memory from Allocator beyond that. Only the parts of the
+ * std::vector interface that small needs. The allocator is a base class so
+ * an empty one takes no space. */
+template <class T, std::size_t INLINE, class Allocator = std::allocator<T>>
+class small_chunk_vector : private Allocator
+{
+  static_assert(std::is_trivially_copyable<T>::value);
+  static_assert(std::is_same<typename Allocator::value_type, T>::value);
+
+private:
+  using traits = std::allocator_traits<Allocator>;
+
+  std::size_t _size;
+  union {
+    T _inline[INLINE];
+    struct {
+      T *ptr;
+      std::size_t cap;
+    } _heap;
+  };
+
+  bool is_inline() const noexcept { return _size <= INLINE; }
+  Allocator &alloc() noexcept { return *this; }
+  Allocator const &alloc() const noexcept { return *this; }
+
+  T *allocate(std::size_t n) { return traits::allocate(alloc(), n); }
+  void free_heap() noexcept
+  {
+    if (!is_inline()) traits::deallocate(alloc(), _heap.ptr, _heap.cap);
+  }
+
+  /* Copies other's elements into storage from our (current) allocator */
+  void assign(small_chunk_vector const &other)
+  {
+    if (other.is_inline()) {
+      free_heap();
+      std::copy(other.data(), other.data() + other._size, _inline);
+    } else if (is_inline() || _heap.cap < other._size) {
+      T *p = allocate(other._size);
+      free_heap();
+      _heap = {p, other._size};
+      std::copy(other.data(), other.data() + other._size, p);
+    } else {
+      std::copy(other.data(), other.data() + other._size, _heap.ptr);
+    }
+    _size = other._size;
+  }
+
+  /* Takes other's heap block, or copies its inline elements */
+  void steal(small_chunk_vector &other) noexcept
+  {
+    free_heap();
+    if (other.is_inline())
+      std::copy(other.data(), other.data() + other._size, _inline);
+    else _heap = other._heap;
+    _size = other._size;
+    other._size = 0;
+  }
+
+public:
+  using allocator_type = Allocator;
+
+  explicit small_chunk_vector(Allocator const &a = Allocator()) noexcept
+      : Allocator(a), _size(0), _inline{}
+  {
+  }
+  small_chunk_vector(small_chunk_vector const &other)
+      : Allocator(traits::select_on_container_copy_construction(other)),
+        _size(0), _inline{}
+  {
+    assign(other);
+  }
+  small_chunk_vector(small_chunk_vector &&other) noexcept
+      : Allocator(std::move(other.alloc())), _size(0), _inline{}
+  {
+    steal(other);
+  }
+  ~small_chunk_vector() { free_heap(); }
+
+  small_chunk_vector &operator=(small_chunk_vector const &other)
+  {
+    if (this == &other) return *this;
+    if constexpr (traits::propagate_on_container_copy_assignment::value) {
+      if (alloc() != other.alloc()) {
+        free_heap();
+        _size = 0;
+      }
+      alloc() = other.alloc();
+    }
+    assign(other);
+    return *this;
+  }
+  small_chunk_vector &operator=(small_chunk_vector &&other) noexcept(
+      traits::propagate_on_container_move_assignment::value ||
+      traits::is_always_equal::value)
+  {
+    if (this == &other) return *this;
+    if constexpr (traits::propagate_on_container_move_assignment::value) {
+      free_heap();
+      _size = 0;
+      alloc() = std::move(other.alloc());
+      steal(other);
+    } else if (alloc() == other.alloc()) {
+      steal(other);
+    } else {
+      assign(other);
+    }
+    return *this;
+  }
+
+  allocator_type get_allocator() const noexcept { return *this; }
+
+  /* New elements are zero; shrinking back to INLINE moves inline again */
+  void resize(std::size_t n)
+  {
+    if (n <= INLINE) {
+      if (!is_inline()) {
+        T *p = _heap.ptr;
+        std::size_t cap = _heap.cap;
+        std::copy(p, p + n, _inline);
+        traits::deallocate(alloc(), p, cap);
+      } else if (n > _size) {
+        std::fill(_inline + _size, _inline + n, T(0));
+      }
+    } else if (is_inline()) {
+      T *p = allocate(n);
+      std::copy(_inline, _inline + _size, p);
+      std::fill(p + _size, p + n, T(0));
+      _heap = {p, n};
+    } else if (n > _heap.cap) {
+      std::size_t cap = std::max(n, 2 * _heap.cap);
+      T *p = allocate(cap);
+      std::copy(_heap.ptr, _heap.ptr + _size, p);
+      std::fill(p + _size, p + n, T(0));
+      traits::deallocate(alloc(), _heap.ptr, _heap.cap);
+      _heap = {p, cap};
+    } else if (n > _size) {
+      std::fill(_heap.ptr + _size, _heap.ptr + n, T(0));
+    }
+    _size = n;
+  }
+
+  std::size_t size() const noexcept { return _size; }
+  T *data() noexcept { return is_inline() ? _inline : _heap.ptr; }
+  T const *data() const noexcept { return is_inline() ? _inline : _heap.ptr; }
+};
+
+/* Runtime size; up to INLINE chunks live in the object, more on the heap */
+template <class ChunkT, std::size_t INLINE,
+          class Allocator = std::allocator<ChunkT>>
+class small
+{
+private:
+  std::size_t _size;
+  small_chunk_vector<ChunkT, INLINE, Allocator> _chunks;
+
+public:
+  using chunk_type = ChunkT;
+  using id_type = std::size_t;
+  using allocator_type = Allocator;
+
+  explicit small(std::size_t size, Allocator const &alloc = Allocator())
+      : _size(size), _chunks(alloc)
+  {
+    _chunks.resize(chunks_for<ChunkT>(size));
+  }
+
+  allocator_type get_allocator() const { return _chunks.get_allocator(); }
+
+  std::size_t size() const { return _size; }
+  std::size_t chunk_count() const { return _chunks.size(); }
+  ChunkT *data() { return _chunks.data(); }
+  ChunkT const *data() const { return _chunks.data(); }
+
+  /* New chunks are zero */
+  void resize(std::size_t size)
+  {
+    _size = size;
+    _chunks.resize(chunks_for<ChunkT>(size));
+  }
+};
+
+/* Non-owning; ChunkT may be const for a read-only view */
+template <class ChunkT>
+class view
+{
+private:
+  ChunkT *_data;
+  std::size_t _size;
+
+public:
+  using chunk_type = std::remove_const_t<ChunkT>;
+  using id_type = std::size_t;
+
+  constexpr view(ChunkT *data, std::size_t size) : _data(data), _size(size)
+  {
+  }
+
+  constexpr std::size_t size() const { return _size; }
+  constexpr std::size_t chunk_count() const
+  {
+    return chunks_for<chunk_type>(_size);
+  }
+  constexpr ChunkT *data() const { return _data; }
+};
+
+template <class S>
+struct is_view : std::false_type {
+};
+template <class ChunkT>
+struct is_view<view<ChunkT>> : std::true_type {
+};
+
+/* Chunk-level access to any basic_bitmap, for the other containers and
+ * bitmap_expr; basic_bitmap befriends only this */
+struct access {
+  template <class B>
+  constexpr static auto chunks(B &b)
+  {
+    return b.chunks();
+  }
+  template <class B>
+  constexpr static std::size_t chunk_count(B const &b)
+  {
+    return b.chunk_count();
+  }
+  template <class B>
+  constexpr static auto pad_mask(B const &b)
+  {
+    return b.pad_mask();
+  }
+};
+} // namespace bitmap_storage
+} // namespace util
@@ -0,0 +1,591 @@
+/* Compressed (Roaring-style) counterpart to dynamic_bitmap
+ *
+ * The index space is split into blocks of 2^16 bits. Empty blocks take no
+ * space at all; every other block holds one of three containers:
+ * + array: sorted 16-bit offsets, used for up to 4096 set bits
+ * + bitmap: 1024 64-bit chunks, used above that
+ * + run: sorted [first, last] pairs, used when run_optimize() (or conversion
+ * from a dynamic_bitmap) finds it to be the smallest of the three
+ *
+ * Mutating operations keep containers in array or bitmap form; call
+ * run_optimize() after bulk building to collapse long runs.
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "util/bit.hh"
+#include "util/bit_kernels.hh"
+#include "util/dynamic_bitmap.hh"
+
+namespace util
+{
+class compressed_bitmap
+{
+public:
+  using id_type = std::size_t;
+
+private:
+  using ChunkT = std::uint64_t;
+  constexpr static std::size_t CHUNK_BITS =
+      std::numeric_limits<ChunkT>::digits;
+  constexpr static std::size_t BLOCK_BITS = std::size_t(1) << 16;
+  constexpr static std::size_t BLOCK_CHUNKS = BLOCK_BITS / CHUNK_BITS;
+  /* Past this many values an array is larger than a bitmap container */
+  constexpr static std::size_t ARRAY_MAX = 4096;
+
+  class container
+  {
+  public:
+    enum kind : std::uint8_t { ARRAY, BITMAP, RUN };
+
+  private:
+    kind _type = ARRAY;
+    std::uint32_t _card = 0;
+    /* ARRAY: sorted offsets; RUN: interleaved first/last pairs */
+    std::vector<std::uint16_t> _vals;
+    /* BITMAP: BLOCK_CHUNKS chunks */
+    std::vector<ChunkT> _bits;
+
+    std::size_t run_count() const { return _vals.size() / 2; }
+    std::uint16_t run_first(std::size_t r) const { return _vals[2 * r]; }
+    std::uint16_t run_last(std::size_t r) const { return _vals[2 * r + 1]; }
+
+    /* Index of the run containing v, or of the first run after it */
+    std::size_t find_run(std::uint32_t v) const
+    {
+      std::size_t lo = 0, hi = run_count();
+      while (lo < hi) {
+        std::size_t mid = (lo + hi) / 2;
+        if (run_last(mid) < v) lo = mid + 1;
+        else hi = mid;
+      }
+      return lo;
+    }
+
+    static void fill_range(ChunkT *dst, std::uint32_t first,
+                           std::uint32_t last)
+    {
+      std::size_t fc = first / CHUNK_BITS, lc = last / CHUNK_BITS;
+      ChunkT fm = ~ChunkT(0) << (first % CHUNK_BITS);
+      ChunkT lm = ~ChunkT(0) >> (CHUNK_BITS - 1 - last % CHUNK_BITS);
+      if (fc == lc) {
+        dst[fc] |= fm & lm;
+        return;
+      }
+      dst[fc] |= fm;
+      std::fill(dst + fc + 1, dst + lc, ~ChunkT(0));
+      dst[lc] |= lm;
+    }
+
+    /* Number of runs in n chunks of a bitmap */
+    static std::size_t count_runs(ChunkT const *src, std::size_t n)
+    {
+      std::size_t runs = 0;
+      ChunkT carry = 0;
+      for (std::size_t i = 0; i < n; ++i) {
+        runs += bitops::popcount((ChunkT)(src[i] & ~((src[i] << 1) | carry)));
+        carry = src[i] >> (CHUNK_BITS - 1);
+      }
+      return runs;
+    }
+
+  public:
+    container() = default;
+
+    /* Picks the smallest container for n (<= BLOCK_CHUNKS) chunks */
+    container(ChunkT const *src, std::size_t n, std::size_t card)
+        : _card(card)
+    {
+      std::size_t runs = count_runs(src, n);
+      if (runs * 4 < std::min<std::size_t>(card * 2, BLOCK_CHUNKS * 8)) {
+        _type = RUN;
+        _vals.reserve(runs * 2);
+        for (std::size_t i = 0; i < n; ++i) {
+          ChunkT chunk = src[i];
+          while (chunk) {
+            auto lo = bitops::countr_zero(chunk);
+            auto len = bitops::countr_one((ChunkT)(chunk >> lo));
+            std::uint32_t first = i * CHUNK_BITS + lo;
+            if (!_vals.empty() && _vals.back() + 1u == first)
+              _vals.back() = first + len - 1;
+            else {
+              _vals.push_back(first);
+              _vals.push_back(first + len - 1);
+            }
+            chunk = lo + len == CHUNK_BITS
+                        ? 0
+                        : chunk & (~ChunkT(0) << (lo + len));
+          }
+        }
+      } else if (card <= ARRAY_MAX) {
+        _type = ARRAY;
+        _vals.reserve(card);
+        for (std::size_t i = 0; i < n; ++i)
+          for (ChunkT chunk = src[i]; chunk; chunk &= chunk - 1)
+            _vals.push_back(i * CHUNK_BITS + bitops::countr_zero(chunk));
+      } else {
+        _type = BITMAP;
+        _bits.assign(BLOCK_CHUNKS, 0);
+        std::copy(src, src + n, _bits.begin());
+      }
+    }
+
+    kind type() const { return _type; }
+    std::size_t count() const { return _card; }
+    bool empty() const { return _card == 0; }
+
+    std::size_t size_in_bytes() const
+    {
+      return sizeof(*this) + _vals.capacity() * sizeof(std::uint16_t) +
+             _bits.capacity() * sizeof(ChunkT);
+    }
+
+    bool test(std::uint32_t v) const
+    {
+      switch (_type) {
+      case ARRAY:
+        return std::binary_search(_vals.begin(), _vals.end(), v);
+      case BITMAP:
+        return (_bits[v / CHUNK_BITS] >> (v % CHUNK_BITS)) & 1;
+      case RUN: {
+        std::size_t r = find_run(v);
+        return r < run_count() && run_first(r) <= v;
+      }
+      }
+      return false;
+    }
+
+    void to_bitmap()
+    {
+      if (_type == BITMAP) return;
+      std::vector<ChunkT> bits(BLOCK_CHUNKS, 0);
+      if (_type == ARRAY)
+        for (auto v : _vals)
+          bits[v / CHUNK_BITS] |= ChunkT(1) << (v % CHUNK_BITS);
+      else
+        for (std::size_t r = 0; r < run_count(); ++r)
+          fill_range(bits.data(), run_first(r), run_last(r));
+      _bits.swap(bits);
+      _vals.clear();
+      _vals.shrink_to_fit();
+      _type = BITMAP;
+    }
+
+    void to_array()
+    {
+      if (_type == ARRAY) return;
+      std::vector<std::uint16_t> vals;
+      vals.reserve(_card);
+      if (_type == BITMAP)
+        for (std::size_t i = 0; i < BLOCK_CHUNKS; ++i)
+          for (ChunkT chunk = _bits[i]; chunk; chunk &= chunk - 1)
+            vals.push_back(i * CHUNK_BITS + bitops::countr_zero(chunk));
+      else
+        for (std::size_t r = 0; r < run_count(); ++r)
+          for (std::uint32_t v = run_first(r); v <= run_last(r); ++v)
+            vals.push_back(v);
+      _vals.swap(vals);
+      _bits.clear();
+      _bits.shrink_to_fit();
+      _type = ARRAY;
+    }
+
+    /* Array or bitmap, whichever is smaller */
+    void normalize()
+    {
+      if (_card <= ARRAY_MAX) to_array();
+      else to_bitmap();
+    }
+
+    void run_optimize()
+    {
+      if (_type == RUN) return;
+      to_bitmap();
+      *this = container(_bits.data(), BLOCK_CHUNKS, _card);
+    }
+
+    void set(std::uint32_t v)
+    {
+      switch (_type) {
+      case ARRAY: {
+        auto it = std::lower_bound(_vals.begin(), _vals.end(), v);
+        if (it != _vals.end() && *it == v) return;
+        _vals.insert(it, v);
+        if (++_card > ARRAY_MAX) to_bitmap();
+        return;
+      }
+      case BITMAP: {
+        ChunkT &chunk = _bits[v / CHUNK_BITS];
+        ChunkT mask = ChunkT(1) << (v % CHUNK_BITS);
+        _card += !(chunk & mask);
+        chunk |= mask;
+        return;
+      }
+      case RUN: {
+        std::size_t r = find_run(v);
+        if (r < run_count() && run_first(r) <= v) return;
+        bool join_prev = r > 0 && run_last(r - 1) + 1u == v;
+        bool join_next = r < run_count() && run_first(r) == v + 1;
+        if (join_prev && join_next) {
+          _vals[2 * r - 1] = run_last(r);
+          _vals.erase(_vals.begin() + 2 * r, _vals.begin() + 2 * r + 2);
+        } else if (join_prev) _vals[2 * r - 1] = v;
+        else if (join_next) _vals[2 * r] = v;
+        else
+          _vals.insert(_vals.begin() + 2 * r,
+                       {(std::uint16_t)v, (std::uint16_t)v});
+        ++_card;
+        return;
+      }
+      }
+    }
+
+    void reset(std::uint32_t v)
+    {
+      if (!test(v)) return;
+      if (_type == RUN) normalize();
+      if (_type == ARRAY) {
+        _vals.erase(std::lower_bound(_vals.begin(), _vals.end(), v));
+        --_card;
+      } else {
+        _bits[v / CHUNK_BITS] &= ~(ChunkT(1) << (v % CHUNK_BITS));
+        if (--_card <= ARRAY_MAX) to_array();
+      }
+    }
+
+    /* First set offset >= from, or BLOCK_BITS. hint carries the array/run
+     * position between calls with increasing from. */
+    std::uint32_t next(std::uint32_t from, std::size_t &hint) const
+    {
+      switch (_type) {
+      case ARRAY:
+        while (hint < _vals.size() && _vals[hint] < from) ++hint;
+        return hint < _vals.size() ? _vals[hint] : BLOCK_BITS;
+      case BITMAP: {
+        std::size_t i = from / CHUNK_BITS;
+        if (i >= BLOCK_CHUNKS) return BLOCK_BITS;
+        ChunkT chunk = _bits[i] & (~ChunkT(0) << (from % CHUNK_BITS));
+        while (!chunk) {
+          if (++i == BLOCK_CHUNKS) return BLOCK_BITS;
+          chunk = _bits[i];
+        }
+        return i * CHUNK_BITS + bitops::countr_zero(chunk);
+      }
+      case RUN:
+        while (hint < run_count() && run_last(hint) < from) ++hint;
+        if (hint == run_count()) return BLOCK_BITS;
+        return std::max<std::uint32_t>(from, run_first(hint));
+      }
+      return BLOCK_BITS;
+    }
+
+    /* ORs the first n chunks of this container into dst */
+    void write_chunks(ChunkT *dst, std::size_t n) const
+    {
+      switch (_type) {
+      case ARRAY:
+        for (auto v : _vals)
+          dst[v / CHUNK_BITS] |= ChunkT(1) << (v % CHUNK_BITS);
+        return;
+      case BITMAP:
+        std::copy(_bits.begin(), _bits.begin() + n, dst);
+        return;
+      case RUN:
+        for (std::size_t r = 0; r < run_count(); ++r)
+          fill_range(dst, run_first(r), run_last(r));
+        return;
+      }
+    }
+
+    void and_with(container const &other)
+    {
+      if (_type == ARRAY || other._type == ARRAY) {
+        std::vector<std::uint16_t> vals;
+        container const &arr = _type == ARRAY ? *this : other;
+        container const &rhs = _type == ARRAY ? other : *this;
+        vals.reserve(std::min(arr._vals.size(), rhs.count()));
+        for (auto v : arr._vals)
+          if (rhs.test(v)) vals.push_back(v);
+        _vals.swap(vals);
+        _bits.clear();
+        _bits.shrink_to_fit();
+        _type = ARRAY;
+        _card = _vals.size();
+        return;
+      }
+      to_bitmap();
+      if (other._type == BITMAP) {
+        kernels::active().and_assign(_bits.data(), other._bits.data(),
+                                     BLOCK_CHUNKS);
+      } else {
+        container tmp(other);
+        tmp.to_bitmap();
+        kernels::active().and_assign(_bits.data(), tmp._bits.data(),
+                                     BLOCK_CHUNKS);
+      }
+      _card = kernels::active().count(_bits.data(), BLOCK_CHUNKS);
+      normalize();
+    }
+
+    void or_with(container const &other)
+    {
+      if (_type == ARRAY && other._type == ARRAY &&
+          _card + other._card <= ARRAY_MAX) {
+        std::vector<std::uint16_t> vals;
+        vals.reserve(_card + other._card);
+        std::set_union(_vals.begin(), _vals.end(), other._vals.begin(),
+                       other._vals.end(), std::back_inserter(vals));
+        _vals.swap(vals);
+        _card = _vals.size();
+        return;
+      }
+      to_bitmap();
+      if (other._type == BITMAP)
+        kernels::active().or_assign(_bits.data(), other._bits.data(),
+                                    BLOCK_CHUNKS);
+      else other.write_chunks(_bits.data(), BLOCK_CHUNKS);
+      _card = kernels::active().count(_bits.data(), BLOCK_CHUNKS);
+      normalize();
+    }
+
+    bool operator==(container const &other) const
+    {
+      if (_card != other._card) return false;
+      if (_type == other._type && _type != BITMAP) return _vals == other._vals;
+      std::vector<ChunkT> lhs(BLOCK_CHUNKS, 0), rhs(BLOCK_CHUNKS, 0);
+      write_chunks(lhs.data(), BLOCK_CHUNKS);
+      other.write_chunks(rhs.data(), BLOCK_CHUNKS);
+      return lhs == rhs;
+    }
+  };
+
+  struct block {
+    std::size_t key;
+    container c;
+  };
+
+  std::size_t _size;
+  std::vector<block> _blocks; /* sorted by key, never empty containers */
+
+  /* First block with key >= key */
+  std::vector<block>::iterator find_block(std::size_t key)
+  {
+    return std::lower_bound(
+        _blocks.begin(), _blocks.end(), key,
+        [](block const &b, std::size_t k) { return b.key < k; });
+  }
+  std::vector<block>::const_iterator find_block(std::size_t key) const
+  {
+    return const_cast<compressed_bitmap *>(this)->find_block(key);
+  }
+
+public:
+  compressed_bitmap(std::size_t size) : _size(size), _blocks{} {}
+
+  explicit compressed_bitmap(dynamic_bitmap const &other)
+      : _size(other.size()), _blocks{}
+  {
+    ChunkT const *src = bitmap_storage::access::chunks(other);
+    std::size_t const chunks = bitmap_storage::access::chunk_count(other);
+    for (std::size_t first = 0; first < chunks; first += BLOCK_CHUNKS) {
+      std::size_t n = std::min(BLOCK_CHUNKS, chunks - first);
+      std::size_t card = kernels::active().count(src + first, n);
+      if (card)
+        _blocks.push_back(
+            {first / BLOCK_CHUNKS, container(src + first, n, card)});
+    }
+  }
+
+  explicit operator dynamic_bitmap() const
+  {
+    dynamic_bitmap ret(_size);
+    ChunkT *dst = bitmap_storage::access::chunks(ret);
+    std::size_t const chunks = bitmap_storage::access::chunk_count(ret);
+    for (auto const &b : _blocks) {
+      std::size_t first = b.key * BLOCK_CHUNKS;
+      b.c.write_chunks(dst + first,
+                       std::min(BLOCK_CHUNKS, chunks - first));
+    }
+    return ret;
+  }
+
+  std::size_t size() const { return _size; }
+
+  /* Heap and object footprint, for comparison with dynamic_bitmap */
+  std::size_t size_in_bytes() const
+  {
+    std::size_t bytes = sizeof(*this);
+    for (auto const &b : _blocks) bytes += sizeof(b.key) + b.c.size_in_bytes();
+    return bytes;
+  }
+
+  compressed_bitmap &set(id_type bit, bool val = true)
+  {
+    if (bit >= _size) throw std::range_error("invalid index");
+    if (!val) return reset(bit);
+    auto it = find_block(bit / BLOCK_BITS);
+    if (it == _blocks.end() || it->key != bit / BLOCK_BITS)
+      it = _blocks.insert(it, {bit / BLOCK_BITS, container()});
+    it->c.set(bit % BLOCK_BITS);
+    return *this;
+  }
+
+  compressed_bitmap &reset(id_type bit)
+  {
+    if (bit >= _size) throw std::range_error("invalid index");
+    auto it = find_block(bit / BLOCK_BITS);
+    if (it == _blocks.end() || it->key != bit / BLOCK_BITS) return *this;
+    it->c.reset(bit % BLOCK_BITS);
+    if (it->c.empty()) _blocks.erase(it);
+    return *this;
+  }
+
+  compressed_bitmap &reset() noexcept
+  {
+    _blocks.clear();
+    return *this;
+  }
+
+  bool test(id_type bit) const
+  {
+    if (bit >= _size) throw std::range_error("invalid index");
+    auto it = find_block(bit / BLOCK_BITS);
+    return it != _blocks.end() && it->key == bit / BLOCK_BITS &&
+           it->c.test(bit % BLOCK_BITS);
+  }
+
+  std::size_t count() const noexcept
+  {
+    std::size_t cnt = 0;
+    for (auto const &b : _blocks) cnt += b.c.count();
+    return cnt;
+  }
+  bool any() const noexcept { return !_blocks.empty(); }
+  bool none() const noexcept { return !any(); }
+
+  /* Converts containers to run form wherever that is smaller */
+  compressed_bitmap &run_optimize()
+  {
+    for (auto &b : _blocks) b.c.run_optimize();
+    return *this;
+  }
+
+  bool operator==(compressed_bitmap const &other) const
+  {
+    if (_size != other._size || _blocks.size() != other._blocks.size())
+      return false;
+    for (std::size_t i = 0; i < _blocks.size(); ++i)
+      if (_blocks[i].key != other._blocks[i].key ||
+          !(_blocks[i].c == other._blocks[i].c))
+        return false;
+    return true;
+  }
+  bool operator!=(compressed_bitmap const &other) const
+  {
+    return !(*this == other);
+  }
+
+  compressed_bitmap &operator&=(compressed_bitmap const &other)
+  {
+    auto out = _blocks.begin();
+    auto rhs = other._blocks.begin();
+    for (auto &b : _blocks) {
+      while (rhs != other._blocks.end() && rhs->key < b.key) ++rhs;
+      if (rhs == other._blocks.end()) break;
+      if (rhs->key != b.key) continue;
+      b.c.and_with(rhs->c);
+      if (b.c.empty()) continue;
+      if (&*out != &b) *out = std::move(b);
+      ++out;
+    }
+    _blocks.erase(out, _blocks.end());
+    return *this;
+  }
+
+  compressed_bitmap &operator|=(compressed_bitmap const &other)
+  {
+    std::vector<block> merged;
+    merged.reserve(_blocks.size() + other._blocks.size());
+    auto lhs = _blocks.begin();
+    auto rhs = other._blocks.begin();
+    while (lhs != _blocks.end() || rhs != other._blocks.end()) {
+      if (rhs == other._blocks.end() ||
+          (lhs != _blocks.end() && lhs->key < rhs->key)) {
+        merged.push_back(std::move(*lhs++));
+      } else if (lhs == _blocks.end() || rhs->key < lhs->key) {
+        merged.push_back(*rhs++);
+      } else {
+        lhs->c.or_with(rhs++->c);
+        merged.push_back(std::move(*lhs++));
+      }
+    }
+    _blocks.swap(merged);
+    return *this;
+  }
+
+  class biterator
+  {
+    friend compressed_bitmap;
+
+  public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = id_type;
+    using pointer = value_type *;
+    using reference = value_type;
+    using iterator_category = std::forward_iterator_tag;
+
+  private:
+    compressed_bitmap const *_ref;
+    std::size_t _block;
+    std::uint32_t _offset;
+    std::size_t _hint;
+
+    biterator(compressed_bitmap const &ref, std::size_t block)
+        : _ref(&ref), _block(block), _offset(0), _hint(0)
+    {
+      if (_block < _ref->_blocks.size())
+        _offset = _ref->_blocks[_block].c.next(0, _hint);
+    }
+
+  public:
+    reference operator*() const
+    {
+      return _ref->_blocks[_block].key * BLOCK_BITS + _offset;
+    }
+
+    biterator &operator++()
+    {
+      if (_block >= _ref->_blocks.size())
+        throw std::range_error("iterate past end");
+      _offset = _ref->_blocks[_block].c.next(_offset + 1, _hint);
+      if (_offset == BLOCK_BITS) *this = biterator(*_ref, _block + 1);
+      return *this;
+    }
+    biterator operator++(int)
+    {
+      biterator ret(*this);
+      ++*this;
+      return ret;
+    }
+
+    bool operator==(biterator const &other) const noexcept
+    {
+      return _ref == other._ref && _block == other._block &&
+             _offset == other._offset;
+    }
+    bool operator!=(biterator const &other) const noexcept
+    {
+      return !operator==(other);
+    }
+  };
+
+  biterator begin() const { return biterator(*this, 0); }
+  biterator end() const { return biterator(*this, _blocks.size()); }
+};
+} // namespace util
@@ -1,13 +1,22 @@
 /* Fitted fixed-width integer types
+ *
+ * uint_exactX_t<N> is an N-bit unsigned integer that wraps modulo 2^N. Up to
+ * 64 bits it wraps the smallest fitting standard type; wider ones are arrays
+ * of 64-bit limbs (least significant first) with add-with-carry and 64x64 ->
+ * 128-bit multiplies, which compile to adc/sbb and mul/mulx where the
+ * compiler has unsigned __int128. Both are constexpr.
  *
  * Author: Ryan Gambord <Ryan.Gambord@oregonstate.edu>
  * Date: July 26 2023
  */
 #pragma once
 #include <algorithm>
+#include <array>
 #include <cstdint>
 #include <iostream>
 #include <limits>
+#include <stdexcept>
+#include <string>
 #include <type_traits>
 
 namespace util
@@ -46,10 +55,9 @@ fit_base(uint);
 fit_base(uint_fast);
 fit_base(uint_least);
 
-template <std::size_t N>
+template <std::size_t N, bool Wide = (N > 64)>
 class uint_exactX_t
 {
-  static_assert(N <= std::numeric_limits<std::uintmax_t>::digits);
   static_assert(N > 0);
 
 public:
@@ -63,7 +71,9 @@ public:
   /* clang-format on */
 private:
   value_type n;
-  constexpr static value_type mask = (~(value_type)0) >> (std::numeric_limits<value_type>::digits - N);
+  constexpr static value_type mask =
+      (value_type)(~(value_type)0) >>
+      (std::numeric_limits<value_type>::digits - N);
 
 public:
   constexpr uint_exactX_t(value_type val) : n(val & mask)
@@ -82,11 +92,16 @@ public:
 
 #define overload_op(op)                                                        \
   template <class T2>                                                          \
-  constexpr auto &operator op##=(T2 rhs) const                                 \
+  constexpr uint_exactX_t &operator op##=(T2 rhs)                              \
   {                                                                            \
-    n = (n op rhs)&mask;                                                       \
+    n = (value_type)((n op rhs) & mask);                                       \
     return *this;                                                              \
   }                                                                            \
+  friend constexpr auto operator op(uint_exactX_t const &lhs,                  \
+                                    uint_exactX_t const &rhs)                  \
+  {                                                                            \
+    return lhs.n op rhs.n;                                                     \
+  }                                                                            \
   template <class T2>                                                          \
   friend constexpr auto operator op(uint_exactX_t const &lhs, T2 const &rhs)   \
   {                                                                            \
@@ -117,11 +132,19 @@ public:
     return *this;
   }
 
-  constexpr uint_exactX_t operator~() const { return (uint_exactX_t){~n}; }
+  constexpr uint_exactX_t operator~() const
+  {
+    return uint_exactX_t((value_type)~n);
+  }
   constexpr bool operator!() const { return !n; }
   constexpr operator bool() const { return n; }
 
 #define overload_op(op)                                                        \
+  friend constexpr bool operator op(uint_exactX_t const &lhs,                  \
+                                    uint_exactX_t const &rhs)                  \
+  {                                                                            \
+    return lhs.n op rhs.n;                                                     \
+  }                                                                            \
   template <class T2>                                                          \
   friend constexpr bool operator op(uint_exactX_t const &lhs, T2 const &rhs)   \
   {                                                                            \
@@ -135,6 +158,8 @@ public:
 
   overload_op(==);
   overload_op(!=);
+  overload_op(<);
+  overload_op(>);
   overload_op(<=);
   overload_op(>=);
   overload_op(&&);
@@ -157,6 +182,7 @@ public:
 
   overload_op(++);
   overload_op(--);
+#undef overload_op
 
   template <class CharT, class Traits>
   friend std::basic_ostream<CharT, Traits> &
@@ -173,5 +199,444 @@ public:
   }
 };
 
+namespace detail
+{
+using limb_t = std::uint64_t;
+#if defined(__SIZEOF_INT128__)
+__extension__ typedef unsigned __int128 dlimb_t;
+#endif
+
+/* a + b + carry, carry in and out 0 or 1 */
+constexpr limb_t
+addc(limb_t a, limb_t b, limb_t &carry) noexcept
+{
+#if defined(__SIZEOF_INT128__)
+  dlimb_t const s = (dlimb_t)a + b + carry;
+  carry = (limb_t)(s >> 64);
+  return (limb_t)s;
+#else
+  limb_t const s = a + b;
+  limb_t const r = s + carry;
+  carry = (s < a) | (r < s);
+  return r;
+#endif
+}
+
+/* a - b - borrow, borrow in and out 0 or 1 */
+constexpr limb_t
+subb(limb_t a, limb_t b, limb_t &borrow) noexcept
+{
+  limb_t const d = a - b;
+  limb_t const r = d - borrow;
+  borrow = (a < b) | (d < borrow);
+  return r;
+}
+
+/* Low half of a * b; the high half goes to hi */
+constexpr limb_t
+mulx(limb_t a, limb_t b, limb_t &hi) noexcept
+{
+#if defined(__SIZEOF_INT128__)
+  dlimb_t const p = (dlimb_t)a * b;
+  hi = (limb_t)(p >> 64);
+  return (limb_t)p;
+#else
+  limb_t const al = (std::uint32_t)a, ah = a >> 32;
+  limb_t const bl = (std::uint32_t)b, bh = b >> 32;
+  limb_t const ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+  limb_t const mid = (ll >> 32) + (std::uint32_t)lh + (std::uint32_t)hl;
+  hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+  return (mid << 32) | (std::uint32_t)ll;
+#endif
+}
+
+/* hi:lo / d with hi < d; the remainder goes to r */
+constexpr limb_t
+divx(limb_t hi, limb_t lo, limb_t d, limb_t &r) noexcept
+{
+#if defined(__SIZEOF_INT128__)
+  dlimb_t const n = ((dlimb_t)hi << 64) | lo;
+  r = (limb_t)(n % d);
+  return (limb_t)(n / d);
+#else
+  limb_t q = 0;
+  for (int i = 63; i >= 0; --i) {
+    limb_t const top = hi >> 63;
+    hi = (hi << 1) | (lo >> 63);
+    lo <<= 1;
+    if (top || hi >= d) {
+      hi -= d;
+      q |= (limb_t)1 << i;
+    }
+  }
+  r = hi;
+  return q;
+#endif
+}
+} // namespace detail
+
+/* N > 64: LIMBS 64-bit limbs, least significant first, the bits of the top
+ * limb past N always zero. Conversions to built-in integers truncate, so
+ * they are explicit. */
+template <std::size_t N>
+class uint_exactX_t<N, true>
+{
+public:
+  using limb_type = detail::limb_t;
+  constexpr static std::size_t LIMBS = (N + 63) / 64;
+
+private:
+  template <std::size_t, bool>
+  friend class uint_exactX_t;
+
+  constexpr static limb_type TOP_MASK = ~(limb_type)0 >> (LIMBS * 64 - N);
+  limb_type l[LIMBS] = {};
+
+  constexpr void mask() { l[LIMBS - 1] &= TOP_MASK; }
+
+  /* Index one past the most significant nonzero limb */
+  constexpr std::size_t used() const
+  {
+    std::size_t n = LIMBS;
+    while (n && !l[n - 1]) --n;
+    return n;
+  }
+
+  constexpr bool bit(std::size_t i) const
+  {
+    return (l[i / 64] >> (i % 64)) & 1;
+  }
+
+  /* *this /= d, returning the remainder */
+  constexpr limb_type div_limb(limb_type d)
+  {
+    limb_type r = 0;
+    for (std::size_t i = LIMBS; i-- > 0;) l[i] = detail::divx(r, l[i], d, r);
+    return r;
+  }
+
+  /* Shift-subtract long division */
+  constexpr static void divmod(uint_exactX_t const &a, uint_exactX_t const &b,
+                               uint_exactX_t &q, uint_exactX_t &r)
+  {
+    if (!b) throw std::domain_error("division by zero");
+    q = a;
+    if (b.used() <= 1) {
+      r = q.div_limb(b.l[0]);
+      return;
+    }
+    q = 0;
+    r = 0;
+    if (a < b) {
+      r = a;
+      return;
+    }
+    for (std::size_t i = a.used() * 64; i-- > 0;) {
+      r <<= 1;
+      r.l[0] |= a.bit(i);
+      if (r >= b) {
+        r -= b;
+        q.l[i / 64] |= (limb_type)1 << (i % 64);
+      }
+    }
+  }
+
+public:
+  constexpr uint_exactX_t() = default;
+
+  template <class T, std::enable_if_t<std::is_integral_v<T> &&
+                                          sizeof(T) <= sizeof(limb_type),
+                                      int> = 0>
+  constexpr uint_exactX_t(T val)
+  {
+    l[0] = (limb_type)val;
+    if constexpr (std::is_signed_v<T>)
+      if (val < 0) /* modulo 2^N, as for built-in unsigned types */
+        for (std::size_t i = 1; i < LIMBS; ++i) l[i] = ~(limb_type)0;
+    mask();
+  }
+
+#if defined(__SIZEOF_INT128__)
+  constexpr uint_exactX_t(detail::dlimb_t val)
+  {
+    l[0] = (limb_type)val;
+    l[1] = (limb_type)(val >> 64);
+    mask();
+  }
+#endif
+
+  /* From limbs, least significant first */
+  explicit constexpr uint_exactX_t(std::array<limb_type, LIMBS> const &limbs)
+  {
+    for (std::size_t i = 0; i < LIMBS; ++i) l[i] = limbs[i];
+    mask();
+  }
+
+  /* Zero-extends or truncates another width */
+  template <std::size_t M>
+  explicit constexpr uint_exactX_t(uint_exactX_t<M, true> const &other)
+  {
+    for (std::size_t i = 0; i < LIMBS && i < other.LIMBS; ++i)
+      l[i] = other.l[i];
+    mask();
+  }
+  template <std::size_t M>
+  explicit constexpr uint_exactX_t(uint_exactX_t<M, false> const &other)
+      : uint_exactX_t((typename uint_exactX_t<M, false>::value_type)other)
+  {
+  }
+
+  constexpr limb_type limb(std::size_t i) const { return l[i]; }
+  constexpr std::array<limb_type, LIMBS> limbs() const
+  {
+    std::array<limb_type, LIMBS> ret{};
+    for (std::size_t i = 0; i < LIMBS; ++i) ret[i] = l[i];
+    return ret;
+  }
+
+  template <class T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+  explicit constexpr operator T() const
+  {
+#if defined(__SIZEOF_INT128__)
+    if constexpr (sizeof(T) > sizeof(limb_type))
+      return (T)(((detail::dlimb_t)l[1] << 64) | l[0]);
+#endif
+    return (T)l[0];
+  }
+#if defined(__SIZEOF_INT128__)
+  /* Not covered above under strict -std=c++17, where __int128 is not an
+   * integral type */
+  explicit constexpr operator detail::dlimb_t() const
+  {
+    return ((detail::dlimb_t)l[1] << 64) | l[0];
+  }
+#endif
+  explicit constexpr operator bool() const { return used() != 0; }
+  constexpr bool operator!() const { return !used(); }
+
+  constexpr uint_exactX_t &operator+=(uint_exactX_t const &rhs)
+  {
+    limb_type c = 0;
+    for (std::size_t i = 0; i < LIMBS; ++i)
+      l[i] = detail::addc(l[i], rhs.l[i], c);
+    mask();
+    return *this;
+  }
+  constexpr uint_exactX_t &operator-=(uint_exactX_t const &rhs)
+  {
+    limb_type b = 0;
+    for (std::size_t i = 0; i < LIMBS; ++i)
+      l[i] = detail::subb(l[i], rhs.l[i], b);
+    mask();
+    return *this;
+  }
+  /* Schoolbook, keeping only the low LIMBS limbs */
+  constexpr uint_exactX_t &operator*=(uint_exactX_t const &rhs)
+  {
+    uint_exactX_t r;
+    for (std::size_t i = 0; i < LIMBS; ++i) {
+      if (!l[i]) continue;
+      limb_type carry = 0;
+      for (std::size_t j = 0; i + j < LIMBS; ++j) {
+        limb_type hi = 0, c1 = 0, c2 = 0;
+        limb_type const lo = detail::mulx(l[i], rhs.l[j], hi);
+        limb_type t = detail::addc(r.l[i + j], lo, c1);
+        r.l[i + j] = detail::addc(t, carry, c2);
+        carry = hi + c1 + c2;
+      }
+    }
+    r.mask();
+    return *this = r;
+  }
+  constexpr uint_exactX_t &operator/=(uint_exactX_t const &rhs)
+  {
+    uint_exactX_t q, r;
+    divmod(*this, rhs, q, r);
+    return *this = q;
+  }
+  constexpr uint_exactX_t &operator%=(uint_exactX_t const &rhs)
+  {
+    uint_exactX_t q, r;
+    divmod(*this, rhs, q, r);
+    return *this = r;
+  }
+
+#define overload_op(op)                                                        \
+  constexpr uint_exactX_t &operator op##=(uint_exactX_t const &rhs)            \
+  {                                                                            \
+    for (std::size_t i = 0; i < LIMBS; ++i) l[i] op## = rhs.l[i];              \
+    return *this;                                                              \
+  }
+
+  overload_op(&);
+  overload_op(|);
+  overload_op(^);
+#undef overload_op
+
+  constexpr uint_exactX_t &operator<<=(std::size_t s)
+  {
+    if (s >= N) return *this = 0;
+    std::size_t const w = s / 64, b = s % 64;
+    for (std::size_t i = LIMBS; i-- > w;) {
+      l[i] = l[i - w] << b;
+      if (b && i > w) l[i] |= l[i - w - 1] >> (64 - b);
+    }
+    for (std::size_t i = 0; i < w; ++i) l[i] = 0;
+    mask();
+    return *this;
+  }
+  constexpr uint_exactX_t &operator>>=(std::size_t s)
+  {
+    if (s >= N) return *this = 0;
+    std::size_t const w = s / 64, b = s % 64;
+    for (std::size_t i = 0; i + w < LIMBS; ++i) {
+      l[i] = l[i + w] >> b;
+      if (b && i + w + 1 < LIMBS) l[i] |= l[i + w + 1] << (64 - b);
+    }
+    for (std::size_t i = LIMBS - w; i < LIMBS; ++i) l[i] = 0;
+    return *this;
+  }
+
+#define overload_op(op)                                                        \
+  friend constexpr uint_exactX_t operator op(uint_exactX_t lhs,                \
+                                             uint_exactX_t const &rhs)         \
+  {                                                                            \
+    return lhs op## = rhs;                                                     \
+  }
+
+  overload_op(+);
+  overload_op(-);
+  overload_op(*);
+  overload_op(/);
+  overload_op(%);
+  overload_op(&);
+  overload_op(|);
+  overload_op(^);
+#undef overload_op
+
+  friend constexpr uint_exactX_t operator<<(uint_exactX_t lhs, std::size_t s)
+  {
+    return lhs <<= s;
+  }
+  friend constexpr uint_exactX_t operator>>(uint_exactX_t lhs, std::size_t s)
+  {
+    return lhs >>= s;
+  }
+
+  constexpr uint_exactX_t operator~() const
+  {
+    uint_exactX_t r;
+    for (std::size_t i = 0; i < LIMBS; ++i) r.l[i] = ~l[i];
+    r.mask();
+    return r;
+  }
+  constexpr uint_exactX_t operator-() const { return uint_exactX_t() - *this; }
+  constexpr uint_exactX_t operator+() const { return *this; }
+
+  constexpr uint_exactX_t &operator++() { return *this += 1; }
+  constexpr uint_exactX_t &operator--() { return *this -= 1; }
+  constexpr uint_exactX_t operator++(int)
+  {
+    auto ret = *this;
+    ++*this;
+    return ret;
+  }
+  constexpr uint_exactX_t operator--(int)
+  {
+    auto ret = *this;
+    --*this;
+    return ret;
+  }
+
+  friend constexpr bool operator==(uint_exactX_t const &lhs,
+                                   uint_exactX_t const &rhs)
+  {
+    for (std::size_t i = 0; i < LIMBS; ++i)
+      if (lhs.l[i] != rhs.l[i]) return false;
+    return true;
+  }
+  friend constexpr bool operator<(uint_exactX_t const &lhs,
+                                  uint_exactX_t const &rhs)
+  {
+    for (std::size_t i = LIMBS; i-- > 0;)
+      if (lhs.l[i] != rhs.l[i]) return lhs.l[i] < rhs.l[i];
+    return false;
+  }
+  friend constexpr bool operator!=(uint_exactX_t const &lhs,
+                                   uint_exactX_t const &rhs)
+  {
+    return !(lhs == rhs);
+  }
+  friend constexpr bool operator>(uint_exactX_t const &lhs,
+                                  uint_exactX_t const &rhs)
+  {
+    return rhs < lhs;
+  }
+  friend constexpr bool operator<=(uint_exactX_t const &lhs,
+                                   uint_exactX_t const &rhs)
+  {
+    return !(rhs < lhs);
+  }
+  friend constexpr bool operator>=(uint_exactX_t const &lhs,
+                                   uint_exactX_t const &rhs)
+  {
+    return !(lhs < rhs);
+  }
+
+  /* Decimal, or hexadecimal under std::hex */
+  template <class CharT, class Traits>
+  friend std::basic_ostream<CharT, Traits> &
+  operator<<(std::basic_ostream<CharT, Traits> &os, uint_exactX_t const &rhs)
+  {
+    bool const hex =
+        (os.flags() & std::ios_base::basefield) == std::ios_base::hex;
+    char const *const digits =
+        (os.flags() & std::ios_base::uppercase) ? "0123456789ABCDEF"
+                                                : "0123456789abcdef";
+    std::string s;
+    uint_exactX_t x = rhs;
+    do {
+      if (hex) {
+        s += digits[x.l[0] & 0xf];
+        x >>= 4;
+      } else {
+        /* Nineteen digits per division */
+        limb_type r = x.div_limb(10000000000000000000u);
+        for (int i = 0; i < 19 && (r || x); ++i, r /= 10) s += digits[r % 10];
+      }
+    } while (x);
+    if (s.empty()) s = "0";
+    std::reverse(s.begin(), s.end());
+    return os << s.c_str();
+  }
+
+  template <class CharT, class Traits>
+  friend std::basic_istream<CharT, Traits> &
+  operator>>(std::basic_istream<CharT, Traits> &is, uint_exactX_t &rhs)
+  {
+    typename std::basic_istream<CharT, Traits>::sentry sentry(is);
+    if (!sentry) return is;
+    bool const hex =
+        (is.flags() & std::ios_base::basefield) == std::ios_base::hex;
+    limb_type const base = hex ? 16 : 10;
+    uint_exactX_t x;
+    bool any = false;
+    for (auto c = is.peek(); c != Traits::eof(); c = is.peek()) {
+      CharT const ch = Traits::to_char_type(c);
+      limb_type d = base;
+      if (ch >= '0' && ch <= '9') d = ch - '0';
+      else if (ch >= 'a' && ch <= 'f') d = ch - 'a' + 10;
+      else if (ch >= 'A' && ch <= 'F') d = ch - 'A' + 10;
+      if (d >= base) break;
+      x = x * base + d;
+      any = true;
+      is.get();
+    }
+    if (any) rhs = x;
+    else is.setstate(std::ios_base::failbit);
+    return is;
+  }
+};
+
 } // namespace fitted_int
 } // namespace util
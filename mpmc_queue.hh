@@ -0,0 +1,129 @@
+/* Bounded multi-producer/multi-consumer queue
+ *
+ * Vyukov's bounded MPMC design: every slot pairs the same in-place storage
+ * ring_buffer uses with a sequence number that says whose turn the slot is.
+ * Producers and consumers each claim a position with one CAS on their own
+ * counter and then hand the slot over with a release store of its sequence
+ * number, so the fast path is lock-free and the two sides never contend on
+ * the same counter.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace util
+{
+template <class T, std::size_t N>
+class mpmc_queue
+{
+  static_assert(N > 0);
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type &;
+  using const_reference = value_type const &;
+  using pointer = value_type *;
+  using const_pointer = value_type const *;
+
+private:
+  /* std::hardware_destructive_interference_size isn't reliably available */
+  constexpr static std::size_t CACHE_LINE = 64;
+
+  struct slot {
+    /* == position: free for the producer of that position
+     * == position + 1: full, for the consumer of that position */
+    std::atomic<size_type> seq;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  slot _slots[N];
+  alignas(CACHE_LINE) std::atomic<size_type> _enqueue_pos;
+  alignas(CACHE_LINE) std::atomic<size_type> _dequeue_pos;
+
+public:
+  mpmc_queue() : _enqueue_pos(0), _dequeue_pos(0)
+  {
+    for (size_type i = 0; i < N; ++i)
+      _slots[i].seq.store(i, std::memory_order_relaxed);
+  }
+  mpmc_queue(mpmc_queue const &) = delete;
+  mpmc_queue &operator=(mpmc_queue const &) = delete;
+  ~mpmc_queue()
+  {
+    size_type end = _enqueue_pos.load(std::memory_order_relaxed);
+    for (size_type i = _dequeue_pos.load(std::memory_order_relaxed); i != end;
+         ++i)
+      ((T *)_slots[i % N].storage)->~T();
+  }
+
+  /* Approximate unless called from a quiescent state. The dequeue counter
+   * never passes the enqueue counter, so loading it first keeps the
+   * difference from going negative; the clamps cover the counters moving
+   * between the two loads. */
+  size_type size() const
+  {
+    size_type deq = _dequeue_pos.load(std::memory_order_acquire);
+    size_type enq = _enqueue_pos.load(std::memory_order_acquire);
+    auto diff = (difference_type)(enq - deq);
+    return diff < 0 ? 0 : std::min((size_type)diff, N);
+  }
+  bool empty() const { return size() == 0; }
+  constexpr size_type capacity() const { return N; }
+
+  /* Returns false (constructing nothing) when full */
+  template <class... Args>
+  bool try_push(Args &&...args)
+  {
+    size_type pos = _enqueue_pos.load(std::memory_order_relaxed);
+    slot *s;
+    for (;;) {
+      s = &_slots[pos % N];
+      size_type seq = s->seq.load(std::memory_order_acquire);
+      auto diff = (difference_type)(seq - pos);
+      if (diff == 0) {
+        if (_enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = _enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    new (s->storage) value_type(std::forward<Args>(args)...);
+    s->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* Returns false (leaving out untouched) when empty */
+  bool try_pop(reference out)
+  {
+    size_type pos = _dequeue_pos.load(std::memory_order_relaxed);
+    slot *s;
+    for (;;) {
+      s = &_slots[pos % N];
+      size_type seq = s->seq.load(std::memory_order_acquire);
+      auto diff = (difference_type)(seq - (pos + 1));
+      if (diff == 0) {
+        if (_dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = _dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    T *p = (T *)s->storage;
+    out = std::move(*p);
+    p->~T();
+    s->seq.store(pos + N, std::memory_order_release);
+    return true;
+  }
+};
+} // namespace util
@@ -0,0 +1,419 @@
+/* Vector of N-bit unsigned integers packed back to back
+ *
+ * fitted_int::uint_exactX_t<N> keeps an N-bit value in a whole 8/16/32/64-bit
+ * word; packed_vector<N> stores N-bit values with no gaps in 64-bit words, so
+ * a vector of 13-bit codes takes 13 bits per element instead of 16. Element
+ * access goes through a proxy reference, as for std::vector<bool>, and
+ * values wider than N bits are truncated on store.
+ *
+ * unpack_into() and pack_from() convert whole ranges at a time. With BMI2
+ * each pdep/pext moves a 64-bit lane of values (8 for N <= 8, 4 for N <= 16,
+ * 2 for N <= 32) between the packed and the unpacked form; otherwise they
+ * walk a bit cursor over the words.
+ *
+ * One zero word past the last element is always allocated, so reading an
+ * element that straddles two words needs no branch.
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "util/bit.hh"
+#include "util/fitted_int.hh"
+
+namespace util
+{
+template <std::size_t N, class Allocator = std::allocator<std::uint64_t>>
+class packed_vector
+{
+  static_assert(N > 0 && N <= 64);
+
+public:
+  using exact_type = fitted_int::uint_exactX_t<N>;
+  using value_type = typename exact_type::value_type;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using allocator_type = Allocator;
+  using word_type = std::uint64_t;
+
+private:
+  constexpr static std::size_t WORD_BITS = 64;
+  constexpr static word_type MASK = ~(word_type)0 >> (WORD_BITS - N);
+  /* Unpacked lane layout of the BMI2 paths: LANES values of LANE_BITS each
+   * per 64-bit lane, N bits of each lane significant */
+  constexpr static std::size_t LANE_BITS =
+      std::numeric_limits<value_type>::digits;
+  constexpr static std::size_t LANES = WORD_BITS / LANE_BITS;
+  constexpr static word_type lane_mask()
+  {
+    word_type m = 0;
+    for (std::size_t i = 0; i < LANES; ++i) m |= MASK << (i * LANE_BITS);
+    return m;
+  }
+
+  std::vector<word_type, Allocator> _words;
+  std::size_t _size;
+
+  constexpr static std::size_t word_count(std::size_t n)
+  {
+    return (n * N + WORD_BITS - 1) / WORD_BITS + 1;
+  }
+
+  /* The `bits` (<= 64) bits at bit position pos; bits past the end read 0 */
+  word_type read_bits(std::size_t pos, std::size_t bits) const
+  {
+    std::size_t const w = pos / WORD_BITS, off = pos % WORD_BITS;
+    word_type v = _words[w] >> off;
+    if (off + bits > WORD_BITS) v |= _words[w + 1] << (WORD_BITS - off);
+    return bits < WORD_BITS ? v & (~(word_type)0 >> (WORD_BITS - bits)) : v;
+  }
+
+  /* ORs v into the bits at bit position pos, which must be zero */
+  void or_bits(std::size_t pos, word_type v)
+  {
+    std::size_t const w = pos / WORD_BITS, off = pos % WORD_BITS;
+    _words[w] |= v << off;
+    if (off) _words[w + 1] |= v >> (WORD_BITS - off);
+  }
+
+  void check_index(std::size_t i) const
+  {
+    if (i >= _size) throw std::range_error("invalid index");
+  }
+
+  /* Zeroes the bits past the last element */
+  void clear_tail()
+  {
+    std::size_t const bit = _size * N;
+    std::size_t const w = bit / WORD_BITS, off = bit % WORD_BITS;
+    if (off) _words[w] &= ~(word_type)0 >> (WORD_BITS - off);
+    else _words[w] = 0;
+    std::fill(_words.begin() + w + 1, _words.end(), 0);
+  }
+
+  template <class T>
+  constexpr static bool LANE_PATH =
+      std::is_same<T, value_type>::value && LANE_BITS <= 32;
+
+public:
+  class reference
+  {
+    friend packed_vector;
+    packed_vector *_v;
+    std::size_t _i;
+    reference(packed_vector *v, std::size_t i) : _v(v), _i(i) {}
+
+  public:
+    reference(reference const &) = default;
+    operator value_type() const { return _v->get(_i); }
+    operator exact_type() const { return _v->get(_i); }
+    reference &operator=(value_type val)
+    {
+      _v->set(_i, val);
+      return *this;
+    }
+    reference &operator=(exact_type val) { return *this = (value_type)val; }
+    reference &operator=(reference const &other)
+    {
+      return *this = (value_type)other;
+    }
+    friend void swap(reference a, reference b)
+    {
+      value_type const tmp = a;
+      a = (value_type)b;
+      b = tmp;
+    }
+  };
+  using const_reference = value_type;
+
+private:
+  template <bool Const>
+  class basic_iterator
+  {
+    friend packed_vector;
+    friend basic_iterator<!Const>;
+    using vector_ptr =
+        std::conditional_t<Const, packed_vector const *, packed_vector *>;
+    vector_ptr _v = nullptr;
+    std::size_t _i = 0;
+    basic_iterator(vector_ptr v, std::size_t i) : _v(v), _i(i) {}
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = packed_vector::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference =
+        std::conditional_t<Const, value_type, packed_vector::reference>;
+    using pointer = void;
+
+    basic_iterator() = default;
+    /* iterator to const_iterator */
+    template <bool C = Const, class = std::enable_if_t<C>>
+    basic_iterator(basic_iterator<false> const &other)
+        : _v(other._v), _i(other._i)
+    {
+    }
+
+    reference operator*() const
+    {
+      if constexpr (Const) return _v->get(_i);
+      else return reference(_v, _i);
+    }
+    reference operator[](difference_type n) const { return *(*this + n); }
+
+    basic_iterator &operator++()
+    {
+      ++_i;
+      return *this;
+    }
+    basic_iterator operator++(int)
+    {
+      auto ret = *this;
+      ++_i;
+      return ret;
+    }
+    basic_iterator &operator--()
+    {
+      --_i;
+      return *this;
+    }
+    basic_iterator operator--(int)
+    {
+      auto ret = *this;
+      --_i;
+      return ret;
+    }
+    basic_iterator &operator+=(difference_type n)
+    {
+      _i += n;
+      return *this;
+    }
+    basic_iterator &operator-=(difference_type n)
+    {
+      _i -= n;
+      return *this;
+    }
+    friend basic_iterator operator+(basic_iterator it, difference_type n)
+    {
+      return it += n;
+    }
+    friend basic_iterator operator+(difference_type n, basic_iterator it)
+    {
+      return it += n;
+    }
+    friend basic_iterator operator-(basic_iterator it, difference_type n)
+    {
+      return it -= n;
+    }
+    /* Members taking a const_iterator, so iterators and const_iterators
+     * mix */
+    difference_type operator-(basic_iterator<true> const &other) const
+    {
+      return (difference_type)_i - (difference_type)other._i;
+    }
+    bool operator==(basic_iterator<true> const &other) const
+    {
+      return _i == other._i;
+    }
+    bool operator!=(basic_iterator<true> const &other) const
+    {
+      return _i != other._i;
+    }
+    bool operator<(basic_iterator<true> const &other) const
+    {
+      return _i < other._i;
+    }
+    bool operator>(basic_iterator<true> const &other) const
+    {
+      return _i > other._i;
+    }
+    bool operator<=(basic_iterator<true> const &other) const
+    {
+      return _i <= other._i;
+    }
+    bool operator>=(basic_iterator<true> const &other) const
+    {
+      return _i >= other._i;
+    }
+  };
+
+public:
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  explicit packed_vector(Allocator const &alloc = Allocator())
+      : _words(1, 0, alloc), _size(0)
+  {
+  }
+  explicit packed_vector(std::size_t n, value_type val = 0,
+                         Allocator const &alloc = Allocator())
+      : _words(word_count(n), 0, alloc), _size(0)
+  {
+    resize(n, val);
+  }
+  packed_vector(std::initializer_list<value_type> il,
+                Allocator const &alloc = Allocator())
+      : packed_vector(alloc)
+  {
+    pack_from(il.begin(), il.size());
+  }
+
+  allocator_type get_allocator() const { return _words.get_allocator(); }
+
+  std::size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  /* Elements that fit without reallocating */
+  std::size_t capacity() const
+  {
+    return (_words.capacity() - 1) * WORD_BITS / N;
+  }
+  void reserve(std::size_t n) { _words.reserve(word_count(n)); }
+  void shrink_to_fit() { _words.shrink_to_fit(); }
+
+  /* The packed words: element i is at bits [i * N, (i + 1) * N) */
+  word_type const *data() const { return _words.data(); }
+  std::size_t bytes() const { return _words.size() * sizeof(word_type); }
+
+  value_type get(std::size_t i) const
+  {
+    std::size_t const bit = i * N;
+    std::size_t const w = bit / WORD_BITS, off = bit % WORD_BITS;
+    /* Two shifts so off == 0 does not shift by 64 */
+    word_type const v =
+        (_words[w] >> off) | (_words[w + 1] << 1 << (WORD_BITS - 1 - off));
+    return (value_type)(v & MASK);
+  }
+
+  void set(std::size_t i, word_type val)
+  {
+    val &= MASK;
+    std::size_t const bit = i * N;
+    std::size_t const w = bit / WORD_BITS, off = bit % WORD_BITS;
+    _words[w] = (_words[w] & ~(MASK << off)) | (val << off);
+    if (off + N > WORD_BITS) {
+      std::size_t const lo = WORD_BITS - off;
+      _words[w + 1] = (_words[w + 1] & ~(MASK >> lo)) | (val >> lo);
+    }
+  }
+
+  reference operator[](std::size_t i) { return reference(this, i); }
+  value_type operator[](std::size_t i) const { return get(i); }
+  reference at(std::size_t i)
+  {
+    check_index(i);
+    return (*this)[i];
+  }
+  value_type at(std::size_t i) const
+  {
+    check_index(i);
+    return get(i);
+  }
+  reference front() { return (*this)[0]; }
+  value_type front() const { return get(0); }
+  reference back() { return (*this)[_size - 1]; }
+  value_type back() const { return get(_size - 1); }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, _size); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, _size); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  void clear()
+  {
+    _words.assign(1, 0);
+    _size = 0;
+  }
+
+  void resize(std::size_t n, value_type val = 0)
+  {
+    std::size_t const old = _size;
+    _words.resize(word_count(n), 0);
+    _size = n;
+    if (n < old) clear_tail();
+    else if (val)
+      for (std::size_t i = old; i < n; ++i) set(i, val);
+  }
+
+  void push_back(value_type val)
+  {
+    if (word_count(_size + 1) > _words.size()) _words.push_back(0);
+    set(_size++, val);
+  }
+
+  void pop_back()
+  {
+    --_size;
+    clear_tail();
+  }
+
+  /* Writes elements [first, first + n) to out, one per T */
+  template <class T>
+  void unpack_into(std::size_t first, std::size_t n, T *out) const
+  {
+    static_assert(std::is_integral<T>::value);
+    if (first > _size || n > _size - first)
+      throw std::range_error("invalid range");
+    std::size_t i = 0;
+#if defined(__BMI2__) && defined(__x86_64__)
+    if constexpr (LANE_PATH<T>) {
+      constexpr word_type LANE_MASK = lane_mask();
+      for (std::size_t const bulk = n - n % LANES; i < bulk; i += LANES) {
+        word_type const lane = bitops::pdep(
+            read_bits((first + i) * N, LANES * N), LANE_MASK);
+        std::memcpy(out + i, &lane, sizeof(lane));
+      }
+    }
+#endif
+    for (; i < n; ++i) out[i] = (T)get(first + i);
+  }
+  template <class T>
+  void unpack_into(T *out) const
+  {
+    unpack_into(0, _size, out);
+  }
+
+  /* Replaces the contents with in[0, n), each truncated to N bits */
+  template <class T>
+  void pack_from(T const *in, std::size_t n)
+  {
+    static_assert(std::is_integral<T>::value);
+    _words.assign(word_count(n), 0);
+    _size = n;
+    std::size_t i = 0;
+#if defined(__BMI2__) && defined(__x86_64__)
+    if constexpr (LANE_PATH<T>) {
+      constexpr word_type LANE_MASK = lane_mask();
+      for (std::size_t const bulk = n - n % LANES; i < bulk; i += LANES) {
+        word_type lane;
+        std::memcpy(&lane, in + i, sizeof(lane));
+        or_bits(i * N, bitops::pext(lane, LANE_MASK));
+      }
+    }
+#endif
+    for (; i < n; ++i) or_bits(i * N, (word_type)in[i] & MASK);
+  }
+
+  friend bool operator==(packed_vector const &a, packed_vector const &b)
+  {
+    /* Bits past the last element are always zero */
+    return a._size == b._size &&
+           std::equal(a._words.begin(),
+                      a._words.begin() + word_count(a._size) - 1,
+                      b._words.begin());
+  }
+  friend bool operator!=(packed_vector const &a, packed_vector const &b)
+  {
+    return !(a == b);
+  }
+};
+} // namespace util
@@ -1,7 +1,12 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <new>
+#include <type_traits>
 #include <utility>
 
 namespace util
@@ -21,10 +26,43 @@ public:
   using pointer = value_type *;
   using const_pointer = value_type const *;
 
+  /* A contiguous run of slots; at most two describe the whole buffer */
+  template <class P>
+  struct basic_span {
+    P data;
+    size_type size;
+    constexpr P begin() const { return data; }
+    constexpr P end() const { return data + size; }
+  };
+  using span = basic_span<pointer>;
+  using const_span = basic_span<const_pointer>;
+
 private:
   pointer _front, _back;
   size_type _size;
 
+  constexpr pointer advance(pointer p, size_type n) const
+  {
+    /* Wrap the index, not the pointer: p + n may lie past the end */
+    size_type off = p - (T *)_buffer[0] + n;
+    if (off >= N) off -= N;
+    return (T *)_buffer[0] + off;
+  }
+
+  /* Slots [p, p + n), split at the end of the storage */
+  constexpr std::array<span, 2> split(pointer p, size_type n) const
+  {
+    size_type first = std::min<size_type>(n, (T *)_buffer[N] - p);
+    return {span{p, first}, span{(T *)_buffer[0], n - first}};
+  }
+
+  template <class It>
+  constexpr static bool IS_MEMCPY =
+      std::is_trivially_copyable<T>::value && std::is_pointer<It>::value &&
+      std::is_same<typename std::remove_cv<typename std::remove_pointer<
+                       It>::type>::type,
+                   T>::value;
+
 public:
   ring_buffer() : _front((T *)_buffer[0]), _back((T *)_buffer[0]), _size(0) {}
   ~ring_buffer()
@@ -36,12 +74,15 @@ public:
   constexpr size_type capacity() const { return N; }
 
   constexpr reference front() { return *_front; }
-  constexpr const_reference front() const { return front(); }
+  constexpr const_reference front() const { return *_front; }
   constexpr reference back()
   {
     return _back == (T *)_buffer[0] ? *(T *)_buffer[N - 1] : *(_back - 1);
   }
-  constexpr const_reference back() const { return back(); }
+  constexpr const_reference back() const
+  {
+    return const_cast<ring_buffer *>(this)->back();
+  }
 
   template <class... Args>
   constexpr void push(Args &&...args)
@@ -60,5 +101,96 @@ public:
     ++_front;
     if (_front == (T *)_buffer[N]) _front = (T *)_buffer[0];
   }
+
+  /* Copies up to n elements from first into the buffer; returns the number
+   * copied, which is less than n only when the buffer fills up */
+  template <class InputIt>
+  size_type push_n(InputIt first, size_type n)
+  {
+    n = std::min(n, N - _size);
+    if constexpr (IS_MEMCPY<InputIt>) {
+      for (span s : split(_back, n)) {
+        if (s.size) std::memcpy(s.data, first, s.size * sizeof(T));
+        first += s.size;
+      }
+    } else {
+      /* If a copy throws, destroy what was built and leave the buffer as it
+       * was */
+      size_type built = 0;
+      try {
+        for (span s : split(_back, n))
+          for (pointer p = s.data; p != s.end(); ++p, ++built)
+            new (p) value_type(*first++);
+      } catch (...) {
+        for (span s : split(_back, built))
+          for (pointer p = s.data; p != s.end(); ++p) p->~T();
+        throw;
+      }
+    }
+    _back = advance(_back, n);
+    _size += n;
+    return n;
+  }
+
+  /* Moves up to n elements out to out; returns the number moved, which is
+   * less than n only when the buffer empties */
+  template <class OutputIt>
+  size_type pop_n(OutputIt out, size_type n)
+  {
+    n = std::min(n, _size);
+    for (span s : split(_front, n)) {
+      if constexpr (IS_MEMCPY<OutputIt>) {
+        if (s.size) std::memcpy(out, s.data, s.size * sizeof(T));
+        out += s.size;
+      } else {
+        for (pointer p = s.data; p != s.end(); ++p) {
+          *out++ = std::move(*p);
+          p->~T();
+        }
+      }
+    }
+    _front = advance(_front, n);
+    _size -= n;
+    return n;
+  }
+
+  /* The stored elements, oldest first */
+  constexpr std::array<span, 2> readable_spans()
+  {
+    return split(_front, _size);
+  }
+  constexpr std::array<const_span, 2> readable_spans() const
+  {
+    auto s = split(_front, _size);
+    return {const_span{s[0].data, s[0].size},
+            const_span{s[1].data, s[1].size}};
+  }
+
+  /* Destroys the n oldest elements, e.g. after reading them in place */
+  constexpr void consume(size_type n)
+  {
+    assert(n <= _size);
+    for (span s : split(_front, n))
+      for (pointer p = s.data; p != s.end(); ++p) p->~T();
+    _front = advance(_front, n);
+    _size -= n;
+  }
+
+  /* Uninitialized free slots, in push order. Fill a prefix (e.g. with
+   * read()) and commit() it; only for trivially copyable T. */
+  constexpr std::array<span, 2> writable_spans()
+  {
+    static_assert(std::is_trivially_copyable<T>::value);
+    return split(_back, N - _size);
+  }
+
+  /* Publishes the first n slots handed out by writable_spans() */
+  constexpr void commit(size_type n)
+  {
+    static_assert(std::is_trivially_copyable<T>::value);
+    assert(n <= N - _size);
+    _back = advance(_back, n);
+    _size += n;
+  }
 };
 } // namespace util
@@ -0,0 +1,95 @@
+/* Lock-free single-producer/single-consumer variant of ring_buffer
+ *
+ * One thread may call try_push() while another calls try_pop(); no other
+ * member may be used concurrently with those two. Each side owns its index
+ * on its own cache line, next to a cached copy of the other side's index, so
+ * the shared lines are only touched when the cache says the buffer looks
+ * full (producer) or empty (consumer).
+ */
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace util
+{
+template <class T, std::size_t N>
+class spsc_ring_buffer
+{
+  static_assert(N > 0);
+
+private:
+  /* std::hardware_destructive_interference_size isn't reliably available */
+  constexpr static std::size_t CACHE_LINE = 64;
+
+  alignas(T) unsigned char _buffer[N][sizeof(T)];
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type &;
+  using const_reference = value_type const &;
+  using pointer = value_type *;
+  using const_pointer = value_type const *;
+
+private:
+  /* Indices only ever increase; the slot is index % N */
+  alignas(CACHE_LINE) std::atomic<size_type> _tail; /* producer */
+  size_type _head_cache;
+  alignas(CACHE_LINE) std::atomic<size_type> _head; /* consumer */
+  size_type _tail_cache;
+
+  pointer slot(size_type i) { return (T *)_buffer[i % N]; }
+
+public:
+  spsc_ring_buffer() : _tail(0), _head_cache(0), _head(0), _tail_cache(0) {}
+  spsc_ring_buffer(spsc_ring_buffer const &) = delete;
+  spsc_ring_buffer &operator=(spsc_ring_buffer const &) = delete;
+  ~spsc_ring_buffer()
+  {
+    size_type tail = _tail.load(std::memory_order_relaxed);
+    for (size_type i = _head.load(std::memory_order_relaxed); i != tail; ++i)
+      slot(i)->~T();
+  }
+
+  /* Approximate unless called from a quiescent state */
+  bool empty() const { return size() == 0; }
+  size_type size() const
+  {
+    return _tail.load(std::memory_order_acquire) -
+           _head.load(std::memory_order_acquire);
+  }
+  constexpr size_type capacity() const { return N; }
+
+  /* Producer side; returns false (constructing nothing) when full */
+  template <class... Args>
+  bool try_push(Args &&...args)
+  {
+    size_type const tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head_cache == N) {
+      _head_cache = _head.load(std::memory_order_acquire);
+      if (tail - _head_cache == N) return false;
+    }
+    new (slot(tail)) value_type(std::forward<Args>(args)...);
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* Consumer side; returns false (leaving out untouched) when empty */
+  bool try_pop(reference out)
+  {
+    size_type const head = _head.load(std::memory_order_relaxed);
+    if (head == _tail_cache) {
+      _tail_cache = _tail.load(std::memory_order_acquire);
+      if (head == _tail_cache) return false;
+    }
+    pointer p = slot(head);
+    out = std::move(*p);
+    p->~T();
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+};
+} // namespace util
@@ -0,0 +1,246 @@
+/* dynamic_bitmap with a hierarchical summary for fast searching
+ *
+ * Level 0 of the summary has one bit per chunk of the bitmap, set iff that
+ * chunk is non-zero; each further level summarizes the one below it the
+ * same way, up to a single chunk. find_first()/find_next() and iteration
+ * descend the summary instead of scanning, so skipping an empty stretch
+ * costs O(levels) rather than one load per 64 bits. A 100M-bit bitmap needs
+ * four levels and about 1.6% extra memory.
+ *
+ * Single-bit updates adjust the summary incrementally; bulk operations
+ * rebuild it in one pass over the existing levels, without allocating.
+ */
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "util/bit.hh"
+#include "util/dynamic_bitmap.hh"
+
+namespace util
+{
+class summary_bitmap
+{
+public:
+  using id_type = std::size_t;
+
+private:
+  using ChunkT = std::uint64_t;
+  constexpr static std::size_t CHUNK_BITS =
+      std::numeric_limits<ChunkT>::digits;
+  constexpr static std::size_t npos = std::size_t(-1);
+  using access = bitmap_storage::access;
+
+  dynamic_bitmap _bits;
+  /* _levels[0] summarizes _bits, _levels[k] summarizes _levels[k - 1] */
+  std::vector<std::vector<ChunkT>> _levels;
+
+  /* Sizes the levels for _bits; the size never changes afterwards */
+  void allocate_levels()
+  {
+    std::size_t n = access::chunk_count(_bits);
+    do {
+      n = std::max<std::size_t>((n + CHUNK_BITS - 1) / CHUNK_BITS, 1);
+      _levels.emplace_back(n);
+    } while (n > 1);
+    rebuild();
+  }
+
+  /* Recomputes every level in place, without allocating */
+  void rebuild() noexcept
+  {
+    ChunkT const *below = access::chunks(_bits);
+    std::size_t n = access::chunk_count(_bits);
+    for (auto &level : _levels) {
+      std::fill(level.begin(), level.end(), ChunkT(0));
+      for (std::size_t i = 0; i < n; ++i)
+        if (below[i]) level[i / CHUNK_BITS] |= ChunkT(1) << (i % CHUNK_BITS);
+      below = level.data();
+      n = level.size();
+    }
+  }
+
+  /* First set bit >= j at level L (L == -1 is the bitmap itself) */
+  std::size_t next(int L, std::size_t j) const
+  {
+    ChunkT const *v = L < 0 ? access::chunks(_bits) : _levels[L].data();
+    std::size_t n = L < 0 ? access::chunk_count(_bits) : _levels[L].size();
+    std::size_t word = j / CHUNK_BITS;
+    if (word >= n) return npos;
+    ChunkT w = v[word] & (~ChunkT(0) << (j % CHUNK_BITS));
+    if (!w) {
+      if (L + 1 == (int)_levels.size()) return npos;
+      word = next(L + 1, word + 1);
+      if (word == npos) return npos;
+      w = v[word];
+    }
+    return word * CHUNK_BITS + bitops::countr_zero(w);
+  }
+
+  void mark(std::size_t chunk)
+  {
+    for (auto &level : _levels) {
+      ChunkT &w = level[chunk / CHUNK_BITS];
+      ChunkT mask = ChunkT(1) << (chunk % CHUNK_BITS);
+      if (w & mask) return;
+      w |= mask;
+      chunk /= CHUNK_BITS;
+    }
+  }
+
+  void unmark(std::size_t chunk)
+  {
+    if (access::chunks(_bits)[chunk]) return;
+    for (auto &level : _levels) {
+      ChunkT &w = level[chunk / CHUNK_BITS];
+      w &= ~(ChunkT(1) << (chunk % CHUNK_BITS));
+      if (w) return;
+      chunk /= CHUNK_BITS;
+    }
+  }
+
+public:
+  summary_bitmap(std::size_t size) : _bits(size) { allocate_levels(); }
+  explicit summary_bitmap(dynamic_bitmap bits) : _bits(std::move(bits))
+  {
+    allocate_levels();
+  }
+
+  dynamic_bitmap const &bits() const noexcept { return _bits; }
+  std::size_t size() const noexcept { return _bits.size(); }
+
+  summary_bitmap &set(id_type bit, bool val = true)
+  {
+    _bits.set(bit, val);
+    if (val) mark(bit / CHUNK_BITS);
+    else unmark(bit / CHUNK_BITS);
+    return *this;
+  }
+  summary_bitmap &reset(id_type bit) { return set(bit, false); }
+  summary_bitmap &flip(id_type bit) { return set(bit, !_bits.test(bit)); }
+  bool test(id_type bit) const { return _bits.test(bit); }
+
+  summary_bitmap &set() noexcept
+  {
+    _bits.set();
+    rebuild();
+    return *this;
+  }
+  summary_bitmap &reset() noexcept
+  {
+    _bits.reset();
+    rebuild();
+    return *this;
+  }
+  summary_bitmap &flip() noexcept
+  {
+    _bits.flip();
+    rebuild();
+    return *this;
+  }
+
+  summary_bitmap &operator&=(dynamic_bitmap const &other)
+  {
+    _bits &= other;
+    rebuild();
+    return *this;
+  }
+  summary_bitmap &operator|=(dynamic_bitmap const &other)
+  {
+    _bits |= other;
+    rebuild();
+    return *this;
+  }
+  summary_bitmap &operator^=(dynamic_bitmap const &other)
+  {
+    _bits ^= other;
+    rebuild();
+    return *this;
+  }
+  summary_bitmap &operator&=(summary_bitmap const &other)
+  {
+    return *this &= other._bits;
+  }
+  summary_bitmap &operator|=(summary_bitmap const &other)
+  {
+    return *this |= other._bits;
+  }
+  summary_bitmap &operator^=(summary_bitmap const &other)
+  {
+    return *this ^= other._bits;
+  }
+
+  std::size_t count() const noexcept { return _bits.count(); }
+  bool any() const noexcept { return _levels.back()[0] != 0; }
+  bool none() const noexcept { return !any(); }
+
+  /* Position of the first set bit, or size() if there is none */
+  std::size_t find_first() const
+  {
+    std::size_t i = next(-1, 0);
+    return i == npos ? size() : i;
+  }
+
+  /* Position of the first set bit after pos, or size() if there is none */
+  std::size_t find_next(std::size_t pos) const
+  {
+    if (pos + 1 >= size()) return size();
+    std::size_t i = next(-1, pos + 1);
+    return i == npos ? size() : i;
+  }
+
+  class biterator
+  {
+    friend summary_bitmap;
+
+  public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = id_type;
+    using pointer = value_type *;
+    using reference = value_type;
+    using iterator_category = std::forward_iterator_tag;
+
+  private:
+    summary_bitmap const *_ref;
+    std::size_t _pos;
+    biterator(summary_bitmap const &ref, std::size_t pos)
+        : _ref(&ref), _pos(pos)
+    {
+    }
+
+  public:
+    reference operator*() const { return _pos; }
+
+    biterator &operator++()
+    {
+      if (_pos >= _ref->size()) throw std::range_error("iterate past end");
+      _pos = _ref->find_next(_pos);
+      return *this;
+    }
+    biterator operator++(int)
+    {
+      biterator ret(*this);
+      ++*this;
+      return ret;
+    }
+
+    bool operator==(biterator const &other) const noexcept
+    {
+      return _ref == other._ref && _pos == other._pos;
+    }
+    bool operator!=(biterator const &other) const noexcept
+    {
+      return !operator==(other);
+    }
+  };
+
+  biterator begin() const { return biterator(*this, find_first()); }
+  biterator end() const { return biterator(*this, size()); }
+};
+} // namespace util
@@ -0,0 +1,115 @@
+/* Fixed-size fork-join thread pool
+ *
+ * run(n, f) calls f(0) ... f(n - 1) spread over the pool's workers and the
+ * calling thread, and returns once every call has finished. Tasks are
+ * handed out one at a time from a shared counter, so uneven tasks balance
+ * themselves. Only one run() executes at a time; concurrent callers wait
+ * their turn. Workers sleep between runs.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+class thread_pool
+{
+private:
+  std::vector<std::thread> _workers;
+
+  std::mutex _run; /* held for the whole of run() */
+  std::mutex _m;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  std::uint64_t _generation;
+  std::size_t _busy; /* workers still inside the current run */
+  bool _stop;
+
+  /* The current job, type-erased without allocating */
+  void (*_call)(void const *, std::size_t);
+  void const *_fn;
+  std::size_t _tasks;
+  std::atomic<std::size_t> _next;
+
+  void work() noexcept
+  {
+    std::size_t i;
+    while ((i = _next.fetch_add(1, std::memory_order_relaxed)) < _tasks)
+      _call(_fn, i);
+  }
+
+  void worker() noexcept
+  {
+    std::uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(_m);
+        _start.wait(lock, [&] { return _stop || _generation != seen; });
+        if (_stop) return;
+        seen = _generation;
+      }
+      work();
+      std::lock_guard<std::mutex> lock(_m);
+      if (--_busy == 0) _done.notify_one();
+    }
+  }
+
+public:
+  /* threads counts the caller of run(), so threads - 1 workers are started */
+  explicit thread_pool(
+      std::size_t threads = std::max(1u, std::thread::hardware_concurrency()))
+      : _generation(0), _busy(0), _stop(false), _call(nullptr), _fn(nullptr),
+        _tasks(0), _next(0)
+  {
+    for (std::size_t i = 1; i < threads; ++i)
+      _workers.emplace_back([this] { worker(); });
+  }
+  thread_pool(thread_pool const &) = delete;
+  thread_pool &operator=(thread_pool const &) = delete;
+  ~thread_pool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(_m);
+      _stop = true;
+    }
+    _start.notify_all();
+    for (auto &t : _workers) t.join();
+  }
+
+  /* Threads available to run(), including the caller */
+  std::size_t size() const noexcept { return _workers.size() + 1; }
+
+  /* f must not throw */
+  template <class F>
+  void run(std::size_t tasks, F const &f)
+  {
+    if (tasks == 0) return;
+    if (tasks == 1 || _workers.empty()) {
+      for (std::size_t i = 0; i < tasks; ++i) f(i);
+      return;
+    }
+    std::lock_guard<std::mutex> run_lock(_run);
+    {
+      std::lock_guard<std::mutex> lock(_m);
+      _call = [](void const *fn, std::size_t i) { (*(F const *)fn)(i); };
+      _fn = &f;
+      _tasks = tasks;
+      _next.store(0, std::memory_order_relaxed);
+      _busy = _workers.size();
+      ++_generation;
+    }
+    _start.notify_all();
+    work();
+    /* Wait for every worker to leave work(), not just for the tasks to be
+     * claimed, so f outlives all its calls */
+    std::unique_lock<std::mutex> lock(_m);
+    _done.wait(lock, [&] { return _busy == 0; });
+  }
+};
+} // namespace util